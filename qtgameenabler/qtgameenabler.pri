@@ -7,24 +7,82 @@ QT += core gui declarative
 # but is also very costly in terms of performance.
 #DEFINES += GE_DEBUG
 
+# Uncomment the following line to mix audio buffers with the generic per-sample
+# reference implementation instead of the specialized mixing kernels. Useful
+# only for verifying the output of the kernels.
+#DEFINES += GE_AUDIO_REFERENCE_MIXING
+
+# Uncomment the following line to disable the SSE2/NEON implementations of the
+# audio mixing routines. Note that to use NEON on ARM targets, the compiler
+# flags must enable it (for example, -mfpu=neon).
+#DEFINES += GE_AUDIO_NO_SIMD
+
+# Uncomment the following line to push the audio to the device from a polling
+# thread instead of letting the device pull it when needed. The push mode is
+# always used on Symbian.
+#DEFINES += GE_AUDIO_PUSH_MODE
+
+# Uncomment the following line to record the time spent in the profiling zones
+# marked with GE_PROFILE_ZONE(), such as the phases of a frame and the audio
+# mixing. The zones of all the threads can be written as a Chrome trace with
+# GE::Profiler::writeChromeTrace(). Without the definition the zones cost
+# nothing.
+#DEFINES += GE_PROFILE
+
 INCLUDEPATH += $${GE_PATH}/src
 
 HEADERS  += \
+    $${GE_PATH}/src/assetarchive.h \
+    $${GE_PATH}/src/audioadpcm.h \
     $${GE_PATH}/src/audiobuffer.h \
+    $${GE_PATH}/src/audiobuffercache.h \
+    $${GE_PATH}/src/audiobufferloader.h \
     $${GE_PATH}/src/audiobufferplayinstance.h \
+    $${GE_PATH}/src/audioconfig.h \
+    $${GE_PATH}/src/audioconvert.h \
+    $${GE_PATH}/src/audiointerpolation.h \
+    $${GE_PATH}/src/audiokernels.h \
     $${GE_PATH}/src/audiomixer.h \
     $${GE_PATH}/src/audioout.h \
+    $${GE_PATH}/src/audiopulldevice.h \
+    $${GE_PATH}/src/audioringbuffer.h \
     $${GE_PATH}/src/audiosourceif.h \
+    $${GE_PATH}/src/audiovoice.h \
+    $${GE_PATH}/src/audiovoicepool.h \
+    $${GE_PATH}/src/clock.h \
+    $${GE_PATH}/src/framestatistics.h \
     $${GE_PATH}/src/gamewindow.h \
-    $${GE_PATH}/src/trace.h
+    $${GE_PATH}/src/lockfreequeue.h \
+    $${GE_PATH}/src/profiler.h \
+    $${GE_PATH}/src/snapshotring.h \
+    $${GE_PATH}/src/streamingaudiosource.h \
+    $${GE_PATH}/src/trace.h \
+    $${GE_PATH}/src/wavparser.h
 
 SOURCES += \
+    $${GE_PATH}/src/assetarchive.cpp \
+    $${GE_PATH}/src/audioadpcm.cpp \
     $${GE_PATH}/src/audiobuffer.cpp \
+    $${GE_PATH}/src/audiobuffercache.cpp \
+    $${GE_PATH}/src/audiobufferloader.cpp \
     $${GE_PATH}/src/audiobufferplayinstance.cpp \
+    $${GE_PATH}/src/audioconfig.cpp \
+    $${GE_PATH}/src/audioconvert.cpp \
+    $${GE_PATH}/src/audiointerpolation.cpp \
+    $${GE_PATH}/src/audiokernels.cpp \
     $${GE_PATH}/src/audiomixer.cpp \
     $${GE_PATH}/src/audioout.cpp \
+    $${GE_PATH}/src/audiopulldevice.cpp \
+    $${GE_PATH}/src/audioringbuffer.cpp \
     $${GE_PATH}/src/audiosourceif.cpp \
-    $${GE_PATH}/src/gamewindow.cpp
+    $${GE_PATH}/src/audiovoice.cpp \
+    $${GE_PATH}/src/audiovoicepool.cpp \
+    $${GE_PATH}/src/clock.cpp \
+    $${GE_PATH}/src/framestatistics.cpp \
+    $${GE_PATH}/src/gamewindow.cpp \
+    $${GE_PATH}/src/profiler.cpp \
+    $${GE_PATH}/src/streamingaudiosource.cpp \
+    $${GE_PATH}/src/wavparser.cpp
 
 
 symbian {
@@ -72,6 +130,10 @@ unix:!symbian {
     # Common
     LIBS += -lX11 -lEGL -lGLESv2
 
+    # For clock_gettime() and clock_nanosleep() in the glibc versions before
+    # 2.17, such as those of Maemo 5 and Harmattan.
+    LIBS += -lrt
+
     maemo5 {
         # Maemo 5 specific
         message(Maemo 5 build)
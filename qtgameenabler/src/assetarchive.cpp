@@ -0,0 +1,728 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#include "assetarchive.h"
+#include <QDir>
+#include <QFile>
+#include <QVector>
+#include <QtAlgorithms>
+#include <limits.h>
+#include <memory.h>
+#include "trace.h" // For debug macros
+
+using namespace GE;
+
+// Constants
+const char GEAssetArchiveMagic[4] = { 'G', 'E', 'A', 'A' };
+const int GEAssetHeaderLength(32);
+const int GEAssetEntryLength(28);
+
+// Offsets in the header
+const int GEHeaderVersion(4);
+const int GEHeaderCount(8);
+const int GEHeaderIndexOffset(12);
+const int GEHeaderNamesOffset(16);
+const int GEHeaderNamesLength(20);
+const int GEHeaderChecksum(24);
+
+// Offsets in an index entry
+const int GEEntryNameOffset(0);
+const int GEEntryNameLength(4);
+const int GEEntryDataOffset(8);
+const int GEEntryStoredLength(12);
+const int GEEntryLength(16);
+const int GEEntryFlags(20);
+const int GEEntryChecksum(24);
+
+// LZ4 block format
+const int GELz4MinMatch(4);
+const int GELz4LastLiterals(5); // Always stored as literals
+const int GELz4MatchFindLimit(12); // No match starts closer to the end
+const int GELz4MaxOffset(65535);
+const int GELz4HashBits(12);
+
+
+namespace {
+
+/*!
+  Reads and writes little-endian values, the data may be unaligned.
+*/
+inline quint32 readUint32(const char *data)
+{
+    const quint8 *bytes = (const quint8*)data;
+    return (quint32)bytes[0] | ((quint32)bytes[1] << 8) |
+        ((quint32)bytes[2] << 16) | ((quint32)bytes[3] << 24);
+}
+
+inline void writeUint32(char *data, quint32 value)
+{
+    data[0] = (char)(value & 0xff);
+    data[1] = (char)((value >> 8) & 0xff);
+    data[2] = (char)((value >> 16) & 0xff);
+    data[3] = (char)((value >> 24) & 0xff);
+}
+
+inline int alignedLength(int length)
+{
+    return (length + GEAssetArchiveAlignment - 1) &
+        ~(GEAssetArchiveAlignment - 1);
+}
+
+
+/*!
+  Writes an LZ4 length extension of \a length into \a output.
+*/
+inline void appendLz4Length(QByteArray &output, int length)
+{
+    while (length >= 255) {
+        output.append((char)255);
+        length -= 255;
+    }
+
+    output.append((char)length);
+}
+
+
+/*!
+  Orders the names of the entries by their UTF-8 bytes.
+*/
+struct PackEntry {
+    QByteArray name;
+    QString fileName;
+};
+
+bool packEntryLessThan(const PackEntry &a, const PackEntry &b)
+{
+    return (a.name < b.name);
+}
+
+} // namespace
+
+
+/*!
+  \class Crc32Table
+  \brief The lookup table of the CRC-32 checksum (IEEE 802.3), built once.
+*/
+class Crc32Table
+{
+public:
+    Crc32Table()
+    {
+        for (quint32 i = 0; i < 256; i++) {
+            quint32 crc(i);
+
+            for (int bit = 0; bit < 8; bit++)
+                crc = (crc & 1) ? (crc >> 1) ^ 0xedb88320 : (crc >> 1);
+
+            m_table[i] = crc;
+        }
+    }
+
+public: // Data
+    quint32 m_table[256];
+};
+
+static const Crc32Table GECrc32Table;
+
+
+/*!
+  \class AssetArchive
+  \brief A read-only archive of game assets, mapped into memory at once.
+
+  Opening hundreds of small files is slow, each costs several system calls.
+  The archive is opened and mapped once instead, and the entries are read
+  straight from the mapping: data() returns the stored entries without
+  copying. For example, AudioBuffer::loadWavData() then
+  plays the samples from the mapping, and QImage::fromData() decodes an
+  image for a GL texture. The archive must stay open as long as the data
+  returned is used.
+
+  The archive consists of a header, an index of fixed size entries sorted
+  by the UTF-8 names for binary search, the names and the data of the
+  entries, each aligned to GEAssetArchiveAlignment bytes. The entries may
+  be LZ4 compressed, these are decompressed into a new array by data().
+  All the values are little-endian.
+
+  The archives are created with pack(), see also the assetpacker tool,
+  which verifies the checksums when the assets are built. The reading
+  methods are thread safe.
+*/
+
+
+/*!
+  Constructor.
+*/
+AssetArchive::AssetArchive()
+    : m_file(0),
+      m_data(0),
+      m_length(0),
+      m_count(0),
+      m_index(0),
+      m_names(0),
+      m_namesLength(0)
+{
+}
+
+
+/*!
+  Destructor.
+*/
+AssetArchive::~AssetArchive()
+{
+    close();
+}
+
+
+/*!
+  Opens the archive \a fileName by mapping it into memory. If the file
+  cannot be mapped, for example a compressed Qt resource, it is read at
+  once. Only the header and the index are checked, see verify(). Returns
+  true if successful, false otherwise.
+*/
+bool AssetArchive::open(const QString &fileName)
+{
+    close();
+
+    QFile *file = new QFile(fileName);
+
+    if (!file->open(QIODevice::ReadOnly)) {
+        DEBUG_INFO("Failed to open" << fileName);
+        delete file;
+        return false;
+    }
+
+    m_length = file->size();
+    uchar *mapping = (m_length > 0 && m_length <= INT_MAX) ?
+        file->map(0, m_length) : 0;
+
+    if (mapping) {
+        // The mapping stays valid after closing.
+        file->close();
+        m_file = file;
+        m_data = (const char*)mapping;
+    }
+    else {
+        m_contents = file->readAll();
+        delete file;
+        m_data = m_contents.constData();
+        m_length = m_contents.size();
+    }
+
+    if (m_length < GEAssetHeaderLength ||
+        memcmp(m_data, GEAssetArchiveMagic, 4) != 0 ||
+        readUint32(m_data + GEHeaderVersion) != GEAssetArchiveVersion) {
+        DEBUG_INFO("Not an asset archive:" << fileName);
+        close();
+        return false;
+    }
+
+    const quint32 count(readUint32(m_data + GEHeaderCount));
+    const quint32 indexOffset(readUint32(m_data + GEHeaderIndexOffset));
+    const quint32 namesOffset(readUint32(m_data + GEHeaderNamesOffset));
+    const quint32 namesLength(readUint32(m_data + GEHeaderNamesLength));
+
+    if (count > (quint32)(m_length / GEAssetEntryLength) ||
+        indexOffset + (qint64)count * GEAssetEntryLength > m_length ||
+        (qint64)namesOffset + namesLength > m_length) {
+        DEBUG_INFO("Corrupted index in" << fileName);
+        close();
+        return false;
+    }
+
+    m_count = (int)count;
+    m_index = m_data + indexOffset;
+    m_names = m_data + namesOffset;
+    m_namesLength = (int)namesLength;
+
+    // Check the bounds once so that the lookups need not.
+    for (int i = 0; i < m_count; i++) {
+        const char *e = entry(i);
+
+        if ((qint64)readUint32(e + GEEntryNameOffset) +
+                readUint32(e + GEEntryNameLength) > m_namesLength ||
+            (qint64)readUint32(e + GEEntryDataOffset) +
+                readUint32(e + GEEntryStoredLength) > m_length ||
+            readUint32(e + GEEntryLength) > (quint32)INT_MAX) {
+            DEBUG_INFO("Corrupted index in" << fileName);
+            close();
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/*!
+  Closes the archive. The data returned by data() becomes invalid.
+*/
+void AssetArchive::close()
+{
+    if (m_file) {
+        m_file->unmap((uchar*)m_data);
+        delete m_file;
+        m_file = 0;
+    }
+
+    m_contents.clear();
+    m_data = 0;
+    m_length = 0;
+    m_count = 0;
+    m_index = 0;
+    m_names = 0;
+    m_namesLength = 0;
+}
+
+
+/*!
+  Verifies the checksum of the whole archive and of each entry. Touches all
+  the data, meant for the build or for debugging. Returns true if the
+  archive is intact, false otherwise.
+*/
+bool AssetArchive::verify() const
+{
+    if (!isOpen())
+        return false;
+
+    if (checksum(m_data + GEAssetHeaderLength,
+                 (int)(m_length - GEAssetHeaderLength)) !=
+            readUint32(m_data + GEHeaderChecksum)) {
+        DEBUG_INFO("Archive checksum mismatch!");
+        return false;
+    }
+
+    for (int i = 0; i < m_count; i++) {
+        const char *e = entry(i);
+        const QString entryName(name(i));
+        const QByteArray entryData(data(entryName));
+
+        if (entryData.size() != (int)readUint32(e + GEEntryLength) ||
+            checksum(entryData.constData(), entryData.size()) !=
+                readUint32(e + GEEntryChecksum)) {
+            DEBUG_INFO("Entry checksum mismatch:" << entryName);
+            return false;
+        }
+    }
+
+    return true;
+}
+
+
+/*!
+  Returns the name of the entry at \a index, in the sorted order.
+*/
+QString AssetArchive::name(int index) const
+{
+    if (index < 0 || index >= m_count)
+        return QString();
+
+    const char *e = entry(index);
+
+    return QString::fromUtf8(m_names + readUint32(e + GEEntryNameOffset),
+                             (int)readUint32(e + GEEntryNameLength));
+}
+
+
+/*!
+  Returns true if the archive has an entry \a name, false otherwise.
+*/
+bool AssetArchive::contains(const QString &name) const
+{
+    return (find(name) >= 0);
+}
+
+
+/*!
+  Returns the uncompressed length of the entry \a name in bytes or -1 if
+  there is no such entry.
+*/
+int AssetArchive::length(const QString &name) const
+{
+    const int index(find(name));
+
+    if (index < 0)
+        return -1;
+
+    return (int)readUint32(entry(index) + GEEntryLength);
+}
+
+
+/*!
+  Returns true if the entry \a name is compressed, i.e. data() copies it,
+  false otherwise.
+*/
+bool AssetArchive::isCompressed(const QString &name) const
+{
+    const int index(find(name));
+
+    if (index < 0)
+        return false;
+
+    return (readUint32(entry(index) + GEEntryFlags) & Lz4Compressed);
+}
+
+
+/*!
+  Returns the data of the entry \a name. A stored entry refers to the
+  archive without a copy (see QByteArray::fromRawData()) and is valid until
+  the archive is closed. A compressed entry is decompressed into a new
+  array. Returns a null array if there is no such entry or it is corrupted.
+*/
+QByteArray AssetArchive::data(const QString &name) const
+{
+    const int index(find(name));
+
+    if (index < 0)
+        return QByteArray();
+
+    const char *e = entry(index);
+    const char *stored = m_data + readUint32(e + GEEntryDataOffset);
+    const int storedLength((int)readUint32(e + GEEntryStoredLength));
+    const int length((int)readUint32(e + GEEntryLength));
+
+    if (!(readUint32(e + GEEntryFlags) & Lz4Compressed))
+        return QByteArray::fromRawData(stored, storedLength);
+
+    QByteArray decompressed;
+    decompressed.resize(length);
+
+    if (!decompressLz4(stored, storedLength, decompressed.data(), length)) {
+        DEBUG_INFO("Corrupted entry:" << name);
+        return QByteArray();
+    }
+
+    return decompressed;
+}
+
+
+/*!
+  Creates the archive \a archiveFileName of the files \a names, relative to
+  \a directory. The names are stored as given, use '/' as the separator.
+  If \a flags contains CompressEntries, the entries which get smaller are
+  stored LZ4 compressed; the best fit are uncompressed formats, such as
+  .wav, since the reading is zero-copy only for the stored entries.
+
+  The archive is verified after writing. Returns true if successful, false
+  otherwise.
+*/
+bool AssetArchive::pack(const QString &archiveFileName,
+                        const QString &directory,
+                        const QStringList &names,
+                        PackFlags flags /* = NoPackFlags */)
+{
+    QVector<PackEntry> entries(names.count());
+    const QDir dir(directory);
+
+    for (int i = 0; i < names.count(); i++) {
+        entries[i].name = names[i].toUtf8();
+        entries[i].fileName = dir.filePath(names[i]);
+    }
+
+    qSort(entries.begin(), entries.end(), packEntryLessThan);
+
+    const int count(entries.count());
+    const int indexOffset(GEAssetHeaderLength);
+    const int namesOffset(indexOffset + count * GEAssetEntryLength);
+    QByteArray index(count * GEAssetEntryLength, 0);
+    QByteArray namesTable;
+    QByteArray contents;
+
+    for (int i = 0; i < count; i++) {
+        if (i > 0 && entries[i].name == entries[i - 1].name) {
+            DEBUG_INFO("Duplicate entry:" << entries[i].fileName);
+            return false;
+        }
+
+        QFile file(entries[i].fileName);
+
+        if (!file.open(QIODevice::ReadOnly)) {
+            DEBUG_INFO("Failed to open" << entries[i].fileName);
+            return false;
+        }
+
+        const QByteArray fileData(file.readAll());
+        QByteArray stored(fileData);
+        quint32 entryFlags(NoEntryFlags);
+
+        if (flags & CompressEntries) {
+            const QByteArray compressed(
+                compressLz4(fileData.constData(), fileData.size()));
+
+            if (compressed.size() < fileData.size()) {
+                stored = compressed;
+                entryFlags |= Lz4Compressed;
+            }
+        }
+
+        char *e = index.data() + i * GEAssetEntryLength;
+        writeUint32(e + GEEntryNameOffset, namesTable.size());
+        writeUint32(e + GEEntryNameLength, entries[i].name.size());
+        writeUint32(e + GEEntryDataOffset, contents.size()); // Relative
+        writeUint32(e + GEEntryStoredLength, stored.size());
+        writeUint32(e + GEEntryLength, fileData.size());
+        writeUint32(e + GEEntryFlags, entryFlags);
+        writeUint32(e + GEEntryChecksum,
+                    checksum(fileData.constData(), fileData.size()));
+
+        namesTable.append(entries[i].name);
+        contents.append(stored);
+        contents.append(QByteArray(alignedLength(contents.size()) -
+                                   contents.size(), 0));
+    }
+
+    const int dataOffset(alignedLength(namesOffset + namesTable.size()));
+
+    // Make the data offsets absolute.
+    for (int i = 0; i < count; i++) {
+        char *e = index.data() + i * GEAssetEntryLength;
+        writeUint32(e + GEEntryDataOffset,
+                    readUint32(e + GEEntryDataOffset) + dataOffset);
+    }
+
+    QByteArray archive(GEAssetHeaderLength, 0);
+    archive.append(index);
+    archive.append(namesTable);
+    archive.append(QByteArray(dataOffset - archive.size(), 0));
+    archive.append(contents);
+
+    char *header = archive.data();
+    memcpy(header, GEAssetArchiveMagic, 4);
+    writeUint32(header + GEHeaderVersion, GEAssetArchiveVersion);
+    writeUint32(header + GEHeaderCount, count);
+    writeUint32(header + GEHeaderIndexOffset, indexOffset);
+    writeUint32(header + GEHeaderNamesOffset, namesOffset);
+    writeUint32(header + GEHeaderNamesLength, namesTable.size());
+    writeUint32(header + GEHeaderChecksum,
+                checksum(archive.constData() + GEAssetHeaderLength,
+                         archive.size() - GEAssetHeaderLength));
+
+    QFile file(archiveFileName);
+
+    if (!file.open(QIODevice::WriteOnly) ||
+        file.write(archive) != archive.size()) {
+        DEBUG_INFO("Failed to write" << archiveFileName);
+        return false;
+    }
+
+    file.close();
+
+    AssetArchive written;
+    return (written.open(archiveFileName) && written.verify());
+}
+
+
+/*!
+  Returns the CRC-32 of \a length bytes of \a data. To checksum data in
+  parts, pass the result of the previous part as \a crc.
+*/
+quint32 AssetArchive::checksum(const char *data,
+                               int length,
+                               quint32 crc /* = 0 */)
+{
+    const quint8 *bytes = (const quint8*)data;
+    crc = ~crc;
+
+    for (int i = 0; i < length; i++)
+        crc = GECrc32Table.m_table[(crc ^ bytes[i]) & 0xff] ^ (crc >> 8);
+
+    return ~crc;
+}
+
+
+/*!
+  Compresses \a length bytes of \a source into an LZ4 block, without the
+  frame format. Uses a single hash probe per position, which compresses
+  less than the reference implementation but decompresses as fast.
+*/
+QByteArray AssetArchive::compressLz4(const char *source, int length)
+{
+    const quint8 *input = (const quint8*)source;
+    QByteArray output;
+    output.reserve(length + length / 255 + 16);
+
+    QVector<int> table(1 << GELz4HashBits, -1);
+    const int matchLimit(length - GELz4LastLiterals);
+    const int findLimit(length - GELz4MatchFindLimit);
+    int anchor(0);
+    int pos(0);
+
+    while (pos < findLimit) {
+        quint32 sequence;
+        memcpy(&sequence, input + pos, 4);
+
+        const int hash((int)((sequence * 2654435761U) >>
+                             (32 - GELz4HashBits)));
+        const int candidate(table[hash]);
+        table[hash] = pos;
+
+        if (candidate < 0 || pos - candidate > GELz4MaxOffset ||
+            memcmp(input + candidate, input + pos, GELz4MinMatch) != 0) {
+            pos++;
+            continue;
+        }
+
+        int matchLength(GELz4MinMatch);
+
+        while (pos + matchLength < matchLimit &&
+               input[candidate + matchLength] == input[pos + matchLength]) {
+            matchLength++;
+        }
+
+        // The sequence: token, literals, offset, match length.
+        const int literals(pos - anchor);
+        const int extraLength(matchLength - GELz4MinMatch);
+
+        output.append((char)((qMin(literals, 15) << 4) |
+                             qMin(extraLength, 15)));
+
+        if (literals >= 15)
+            appendLz4Length(output, literals - 15);
+
+        output.append(source + anchor, literals);
+        output.append((char)((pos - candidate) & 0xff));
+        output.append((char)((pos - candidate) >> 8));
+
+        if (extraLength >= 15)
+            appendLz4Length(output, extraLength - 15);
+
+        pos += matchLength;
+        anchor = pos;
+    }
+
+    // The rest are literals.
+    const int literals(length - anchor);
+    output.append((char)(qMin(literals, 15) << 4));
+
+    if (literals >= 15)
+        appendLz4Length(output, literals - 15);
+
+    output.append(source + anchor, literals);
+    return output;
+}
+
+
+/*!
+  Decompresses the LZ4 block of \a length bytes in \a source into exactly
+  \a targetLength bytes of \a target. Every length and offset is checked,
+  so corrupted data cannot write outside of the target. Returns true if
+  successful, false otherwise.
+*/
+bool AssetArchive::decompressLz4(const char *source,
+                                 int length,
+                                 char *target,
+                                 int targetLength)
+{
+    const quint8 *input = (const quint8*)source;
+    const quint8 *inputEnd = input + length;
+    char *output = target;
+    char *outputEnd = target + targetLength;
+
+    while (input < inputEnd) {
+        const int token(*input++);
+        int literals(token >> 4);
+
+        if (literals == 15) {
+            int extra(255);
+
+            while (extra == 255) {
+                if (input >= inputEnd)
+                    return false;
+
+                extra = *input++;
+                literals += extra;
+            }
+        }
+
+        if (literals > inputEnd - input || literals > outputEnd - output)
+            return false;
+
+        memcpy(output, input, literals);
+        input += literals;
+        output += literals;
+
+        if (input == inputEnd) {
+            // The last sequence has no match.
+            break;
+        }
+
+        if (inputEnd - input < 2)
+            return false;
+
+        const int offset(input[0] | (input[1] << 8));
+        input += 2;
+
+        if (offset == 0 || offset > output - target)
+            return false;
+
+        int matchLength(token & 15);
+
+        if (matchLength == 15) {
+            int extra(255);
+
+            while (extra == 255) {
+                if (input >= inputEnd)
+                    return false;
+
+                extra = *input++;
+                matchLength += extra;
+            }
+        }
+
+        matchLength += GELz4MinMatch;
+
+        if (matchLength > outputEnd - output)
+            return false;
+
+        // The match may overlap the output, copy byte by byte.
+        const char *match = output - offset;
+
+        for (int i = 0; i < matchLength; i++)
+            output[i] = match[i];
+
+        output += matchLength;
+    }
+
+    return (output == outputEnd);
+}
+
+
+/*!
+  Returns the index of the entry \a name or -1 if there is no such entry.
+  A binary search over the sorted index.
+*/
+int AssetArchive::find(const QString &name) const
+{
+    const QByteArray key(name.toUtf8());
+    int low(0);
+    int high(m_count - 1);
+
+    while (low <= high) {
+        const int middle((low + high) / 2);
+        const char *e = entry(middle);
+        const int nameLength((int)readUint32(e + GEEntryNameLength));
+        const int result(memcmp(m_names + readUint32(e + GEEntryNameOffset),
+                                key.constData(),
+                                qMin(nameLength, key.size())));
+
+        if (result < 0 || (result == 0 && nameLength < key.size()))
+            low = middle + 1;
+        else if (result > 0 || nameLength > key.size())
+            high = middle - 1;
+        else
+            return middle;
+    }
+
+    return -1;
+}
+
+
+/*!
+  Returns the index entry at \a index.
+*/
+const char *AssetArchive::entry(int index) const
+{
+    return m_index + index * GEAssetEntryLength;
+}
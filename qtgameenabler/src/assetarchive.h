@@ -0,0 +1,93 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#ifndef GEASSETARCHIVE_H
+#define GEASSETARCHIVE_H
+
+#include <QByteArray>
+#include <QFlags>
+#include <QString>
+#include <QStringList>
+
+// Forward declarations
+class QFile;
+
+
+namespace GE {
+
+// Constants
+const quint32 GEAssetArchiveVersion(1);
+const int GEAssetArchiveAlignment(16); // Of the entry data, in bytes
+
+
+class AssetArchive
+{
+public: // Data types
+
+    enum EntryFlag {
+        NoEntryFlags = 0x0,
+        Lz4Compressed = 0x1 // The data is an LZ4 block
+    };
+
+    enum PackFlag {
+        NoPackFlags = 0x0,
+        CompressEntries = 0x1 // LZ4 compress the entries which shrink
+    };
+
+    Q_DECLARE_FLAGS(PackFlags, PackFlag)
+
+public:
+    AssetArchive();
+    ~AssetArchive();
+
+public:
+    bool open(const QString &fileName);
+    void close();
+    inline bool isOpen() const { return (m_data != 0); }
+    bool verify() const;
+
+    inline int count() const { return m_count; }
+    QString name(int index) const;
+    bool contains(const QString &name) const;
+    int length(const QString &name) const;
+    bool isCompressed(const QString &name) const;
+    QByteArray data(const QString &name) const;
+
+    static bool pack(const QString &archiveFileName,
+                     const QString &directory,
+                     const QStringList &names,
+                     PackFlags flags = NoPackFlags);
+
+    static quint32 checksum(const char *data, int length, quint32 crc = 0);
+    static QByteArray compressLz4(const char *source, int length);
+    static bool decompressLz4(const char *source,
+                              int length,
+                              char *target,
+                              int targetLength);
+
+protected:
+    int find(const QString &name) const;
+    const char *entry(int index) const;
+
+protected: // Data
+    QFile *m_file; // Owned, with a mapped archive only
+    const char *m_data; // The whole archive, mapped or in m_contents
+    qint64 m_length;
+    QByteArray m_contents; // If the archive could not be mapped
+    int m_count;
+    const char *m_index;
+    const char *m_names;
+    int m_namesLength;
+
+private:
+    Q_DISABLE_COPY(AssetArchive)
+};
+
+} // namespace GE
+
+Q_DECLARE_OPERATORS_FOR_FLAGS(GE::AssetArchive::PackFlags)
+
+#endif // GEASSETARCHIVE_H
@@ -0,0 +1,393 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#include "audioadpcm.h"
+#include <QFile>
+#include <QVector>
+#include <memory.h>
+#include "audiobuffer.h"
+#include "audioconvert.h"
+#include "trace.h" // For debug macros
+
+using namespace GE;
+
+// Constants
+const int GEImaMaxStepIndex(88);
+const int GEImaBlockHeaderSize(4); // Per channel, in bytes
+
+const int GEImaIndexTable[16] = {
+    -1, -1, -1, -1, 2, 4, 6, 8,
+    -1, -1, -1, -1, 2, 4, 6, 8
+};
+
+const int GEImaStepTable[GEImaMaxStepIndex + 1] = {
+    7, 8, 9, 10, 11, 12, 13, 14, 16, 17,
+    19, 21, 23, 25, 28, 31, 34, 37, 41, 45,
+    50, 55, 60, 66, 73, 80, 88, 97, 107, 118,
+    130, 143, 157, 173, 190, 209, 230, 253, 279, 307,
+    337, 371, 408, 449, 494, 544, 598, 658, 724, 796,
+    876, 963, 1060, 1166, 1282, 1411, 1552, 1707, 1878, 2066,
+    2272, 2499, 2749, 3024, 3327, 3660, 4026, 4428, 4871, 5358,
+    5894, 6484, 7132, 7845, 8630, 9493, 10442, 11487, 12635, 13899,
+    15289, 16818, 18500, 20350, 22385, 24623, 27086, 29794, 32767
+};
+
+
+namespace {
+
+/*!
+  Decodes \a nibble, updating the \a predictor and the step \a index.
+  Returns the decoded sample.
+*/
+inline int decodeNibble(int nibble, int &predictor, int &index)
+{
+    const int step(GEImaStepTable[index]);
+    int diff(step >> 3);
+
+    if (nibble & 1)
+        diff += step >> 2;
+
+    if (nibble & 2)
+        diff += step >> 1;
+
+    if (nibble & 4)
+        diff += step;
+
+    if (nibble & 8)
+        predictor -= diff;
+    else
+        predictor += diff;
+
+    predictor = qBound(-32768, predictor, 32767);
+    index = qBound(0, index + GEImaIndexTable[nibble], GEImaMaxStepIndex);
+    return predictor;
+}
+
+
+/*!
+  Encodes \a sample, updating the \a predictor and the step \a index exactly
+  as the decoder will. Returns the nibble.
+*/
+inline int encodeNibble(int sample, int &predictor, int &index)
+{
+    const int step(GEImaStepTable[index]);
+    int diff(sample - predictor);
+    int nibble(0);
+
+    if (diff < 0) {
+        nibble = 8;
+        diff = -diff;
+    }
+
+    if (diff >= step) {
+        nibble |= 4;
+        diff -= step;
+    }
+
+    if (diff >= (step >> 1)) {
+        nibble |= 2;
+        diff -= step >> 1;
+    }
+
+    if (diff >= (step >> 2))
+        nibble |= 1;
+
+    decodeNibble(nibble, predictor, index);
+    return nibble;
+}
+
+
+/*!
+  Reads the block header of \a channel into \a predictor and \a index.
+*/
+inline void readHeader(const quint8 *block,
+                       int channel,
+                       int &predictor,
+                       int &index)
+{
+    const quint8 *header = block + channel * GEImaBlockHeaderSize;
+    predictor = (qint16)(header[0] | (header[1] << 8));
+    index = qBound(0, (int)header[2], GEImaMaxStepIndex);
+}
+
+} // namespace
+
+
+/*!
+  \class AudioAdpcm
+  \brief Decoder and encoder for IMA ADPCM compressed .wav data.
+
+  IMA ADPCM stores each sample in four bits, a quarter of the size of 16-bit
+  PCM. The data consists of independent blocks of blockAlign bytes; each
+  block starts with a header per channel followed by the samples of the
+  channels interleaved in groups of eight. AudioBuffer keeps the data
+  compressed and AudioVoice decodes it block by block while mixing.
+*/
+
+
+/*!
+  Returns the number of frames in a block of \a blockAlign bytes with
+  \a channels channels. Only the whole groups of four bytes per channel are
+  counted, so a partial last block is never decoded past its end.
+*/
+int AudioAdpcm::samplesPerBlock(int blockAlign, int channels)
+{
+    if (channels < 1 || blockAlign < GEImaBlockHeaderSize * channels)
+        return 0;
+
+    const int groupSize(4 * channels);
+    const int groups((blockAlign - GEImaBlockHeaderSize * channels) /
+                     groupSize);
+    return groups * 8 + 1;
+}
+
+
+/*!
+  Returns the number of frames in \a dataLength bytes of data consisting of
+  blocks of \a blockAlign bytes. The last block may be partial.
+*/
+int AudioAdpcm::frameCount(int dataLength, int blockAlign, int channels)
+{
+    if (blockAlign <= 0)
+        return 0;
+
+    return (dataLength / blockAlign) * samplesPerBlock(blockAlign, channels) +
+        samplesPerBlock(dataLength % blockAlign, channels);
+}
+
+
+/*!
+  Decodes the block of \a blockLength bytes from \a block into \a target as
+  interleaved samples with \a channels channels. The bytes of an incomplete
+  group at the end of a partial block are ignored. Returns the number of
+  frames decoded.
+*/
+int AudioAdpcm::decodeBlock(const void *block,
+                            int blockLength,
+                            int channels,
+                            AUDIO_SAMPLE_TYPE *target)
+{
+    const int frames(samplesPerBlock(blockLength, channels));
+
+    if (frames <= 0 || channels > 2)
+        return 0;
+
+    const quint8 *data = (const quint8*)block;
+    int predictor[2];
+    int index[2];
+
+    for (int c = 0; c < channels; c++) {
+        readHeader(data, c, predictor[c], index[c]);
+        target[c] = (AUDIO_SAMPLE_TYPE)predictor[c];
+    }
+
+    data += GEImaBlockHeaderSize * channels;
+
+    // Each channel has four bytes, i.e. eight samples, per group.
+    for (int frame = 1; frame < frames; frame += 8) {
+        for (int c = 0; c < channels; c++) {
+            const int count(qMin(8, frames - frame));
+            AUDIO_SAMPLE_TYPE *output = target + frame * channels + c;
+
+            for (int i = 0; i < count; i++) {
+                const int nibble((data[i >> 1] >> ((i & 1) << 2)) & 15);
+                *output = (AUDIO_SAMPLE_TYPE)
+                    decodeNibble(nibble, predictor[c], index[c]);
+                output += channels;
+            }
+
+            data += 4;
+        }
+    }
+
+    return frames;
+}
+
+
+/*!
+  Decodes the single sample at \a index of \a channel from \a block. Slow,
+  used by the reference sample function of AudioBuffer only.
+*/
+AUDIO_SAMPLE_TYPE AudioAdpcm::decodeSample(const void *block,
+                                           int channels,
+                                           int channel,
+                                           int index)
+{
+    const quint8 *data = (const quint8*)block;
+    int predictor(0);
+    int stepIndex(0);
+
+    readHeader(data, channel, predictor, stepIndex);
+    data += GEImaBlockHeaderSize * channels;
+
+    for (int frame = 1; frame <= index; frame++) {
+        const int group((frame - 1) >> 3);
+        const int i((frame - 1) & 7);
+        const quint8 *bytes = data + (group * channels + channel) * 4;
+
+        decodeNibble((bytes[i >> 1] >> ((i & 1) << 2)) & 15, predictor,
+                     stepIndex);
+    }
+
+    return (AUDIO_SAMPLE_TYPE)predictor;
+}
+
+
+/*!
+  Encodes \a frames frames of interleaved 16-bit \a source samples with
+  \a channels channels into blocks of \a blockAlign bytes. The last block is
+  padded with silence. Returns the encoded data.
+*/
+QByteArray AudioAdpcm::encode(const AUDIO_SAMPLE_TYPE *source,
+                              int frames,
+                              int channels,
+                              int blockAlign)
+{
+    const int blockFrames(samplesPerBlock(blockAlign, channels));
+
+    if (blockFrames <= 1 || channels > 2 || frames <= 0 ||
+        blockAlign % (4 * channels) != 0) {
+        DEBUG_INFO("Invalid parameters for encoding!");
+        return QByteArray();
+    }
+
+    const int blocks((frames + blockFrames - 1) / blockFrames);
+    QByteArray encoded(blocks * blockAlign, 0);
+    quint8 *data = (quint8*)encoded.data();
+    int predictor[2] = { 0, 0 };
+    int index[2] = { 0, 0 };
+
+    for (int block = 0; block < blocks; block++) {
+        const int first(block * blockFrames);
+
+        for (int c = 0; c < channels; c++) {
+            // The first sample is stored as is in the header.
+            predictor[c] = (first < frames) ? source[first * channels + c] : 0;
+            data[0] = (quint8)(predictor[c] & 0xff);
+            data[1] = (quint8)((predictor[c] >> 8) & 0xff);
+            data[2] = (quint8)index[c];
+            data[3] = 0;
+            data += GEImaBlockHeaderSize;
+        }
+
+        for (int frame = 1; frame < blockFrames; frame += 8) {
+            for (int c = 0; c < channels; c++) {
+                for (int i = 0; i < 8; i++) {
+                    const int sourceFrame(first + frame + i);
+                    const int sample((sourceFrame < frames) ?
+                                     source[sourceFrame * channels + c] : 0);
+                    const int nibble(
+                        encodeNibble(sample, predictor[c], index[c]));
+
+                    data[i >> 1] |= (quint8)(nibble << ((i & 1) << 2));
+                }
+
+                data += 4;
+            }
+        }
+    }
+
+    return encoded;
+}
+
+
+/*!
+  Conversion tool for the assets. Loads the PCM .wav file \a sourceFileName
+  and writes it IMA ADPCM encoded into \a targetFileName with blocks of
+  \a blockAlign bytes (GEDefaultAdpcmBlockAlign per channel if 0). Files
+  with blocks larger than GEMaxAdpcmBlockAlign per channel are decompressed
+  when loaded instead of while mixing. Mono and
+  stereo files of any supported bit depth are accepted, the sample rate is
+  kept. Returns true if successful, false otherwise.
+*/
+bool AudioAdpcm::encodeWav(const QString &sourceFileName,
+                           const QString &targetFileName,
+                           int blockAlign /* = 0 */)
+{
+    AudioBuffer *buffer = AudioBuffer::loadWav(sourceFileName);
+
+    if (!buffer)
+        return false;
+
+    const int channels(buffer->getNofChannels());
+    const int frames(buffer->getFrameCount());
+    const int sampleRate(buffer->getSamplesPerSec());
+
+    if (blockAlign <= 0)
+        blockAlign = GEDefaultAdpcmBlockAlign * channels;
+
+    if (buffer->isCompressed() ||
+        !AudioConverter::isSupported(buffer->getBitsPerSample(), channels)) {
+        DEBUG_INFO("Unsupported source format!");
+        delete buffer;
+        return false;
+    }
+
+    // Convert to 16 bits, keeping the channel count.
+    QVector<AUDIO_SAMPLE_TYPE> stereo(frames * 2);
+    QVector<AUDIO_SAMPLE_TYPE> pcm(frames * channels);
+    AudioConverter::toStereo(buffer->getRawData(), frames,
+                             buffer->getBitsPerSample(), channels,
+                             stereo.data());
+    delete buffer;
+
+    for (int i = 0; i < frames * channels; i++)
+        pcm[i] = stereo[(i / channels) * 2 + i % channels];
+
+    const QByteArray data(AudioAdpcm::encode(pcm.constData(), frames,
+                                             channels, blockAlign));
+
+    if (data.isEmpty())
+        return false;
+
+    const quint32 blockFrames(samplesPerBlock(blockAlign, channels));
+    const quint32 fmtSize(20);
+    const quint16 audioFormat(GEWavFormatImaAdpcm);
+    const quint16 nofChannels(channels);
+    const quint32 samplesPerSec(sampleRate);
+    const quint32 byteRate((quint32)((qint64)sampleRate * blockAlign /
+                                     blockFrames));
+    const quint16 align(blockAlign);
+    const quint16 bitsPerSample(4);
+    const quint16 extraSize(2);
+    const quint16 samplesInBlock(blockFrames);
+    const quint32 factSize(4);
+    const quint32 sampleCount(frames);
+    const quint32 dataSize(data.size());
+    const quint32 riffSize(4 + 8 + fmtSize + 8 + factSize + 8 + dataSize);
+
+    QFile file(targetFileName);
+
+    if (!file.open(QIODevice::WriteOnly)) {
+        DEBUG_INFO("Failed to open" << targetFileName);
+        return false;
+    }
+
+    file.write("RIFF", 4);
+    file.write((const char*)&riffSize, 4);
+    file.write("WAVE", 4);
+
+    file.write("fmt ", 4);
+    file.write((const char*)&fmtSize, 4);
+    file.write((const char*)&audioFormat, 2);
+    file.write((const char*)&nofChannels, 2);
+    file.write((const char*)&samplesPerSec, 4);
+    file.write((const char*)&byteRate, 4);
+    file.write((const char*)&align, 2);
+    file.write((const char*)&bitsPerSample, 2);
+    file.write((const char*)&extraSize, 2);
+    file.write((const char*)&samplesInBlock, 2);
+
+    // The exact length, the last block may be padded.
+    file.write("fact", 4);
+    file.write((const char*)&factSize, 4);
+    file.write((const char*)&sampleCount, 4);
+
+    file.write("data", 4);
+    file.write((const char*)&dataSize, 4);
+
+    return (file.write(data) == data.size());
+}
@@ -0,0 +1,49 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#ifndef GEAUDIOADPCM_H
+#define GEAUDIOADPCM_H
+
+#include <QByteArray>
+#include <QString>
+#include "audiosourceif.h"
+#include "wavparser.h"
+
+
+namespace GE {
+
+// Constants
+const int GEDefaultAdpcmBlockAlign(512); // Per channel, in bytes
+const int GEMaxAdpcmBlockAlign(2048); // Per channel, for decoding while mixing
+
+
+class AudioAdpcm
+{
+public:
+    static int samplesPerBlock(int blockAlign, int channels);
+    static int frameCount(int dataLength, int blockAlign, int channels);
+
+    static int decodeBlock(const void *block,
+                           int blockLength,
+                           int channels,
+                           AUDIO_SAMPLE_TYPE *target);
+    static AUDIO_SAMPLE_TYPE decodeSample(const void *block,
+                                          int channels,
+                                          int channel,
+                                          int index);
+    static QByteArray encode(const AUDIO_SAMPLE_TYPE *source,
+                             int frames,
+                             int channels,
+                             int blockAlign);
+
+    static bool encodeWav(const QString &sourceFileName,
+                          const QString &targetFileName,
+                          int blockAlign = 0);
+};
+
+} // namespace GE
+
+#endif // GEAUDIOADPCM_H
@@ -6,39 +6,25 @@
 
 #include "audiobuffer.h"
 
+#include <limits.h>
 #include <math.h>
+#include <memory.h>
 #include <QFile>
+#include <QResource>
 
+#include "audioadpcm.h"
 #include "audiobufferplayinstance.h"
+#include "audioconfig.h"
+#include "audioconvert.h"
+#include "audiokernels.h"
 #include "audiomixer.h"
+#include "audiovoicepool.h"
 #include "trace.h"
+#include "wavparser.h"
 
 using namespace GE;
 
 
-/*!
-  Header for wav data
-*/
-struct SWavHeader {
-    char chunkID[4];
-    unsigned int chunkSize;
-    char format[4];
-
-    unsigned char subchunk1id[4];
-    unsigned int subchunk1size;
-    unsigned short audioFormat;
-    unsigned short nofChannels;
-    unsigned int sampleRate;
-    unsigned int byteRate;
-
-    unsigned short blockAlign;
-    unsigned short bitsPerSample;
-
-    unsigned char subchunk2id[4];
-    unsigned int subchunk2size;
-};
-
-
 /*!
  * \class AudioBuffer
  * \brief A class to hold audio information (a buffer).
@@ -53,10 +39,16 @@ AudioBuffer::AudioBuffer(QObject *parent /* = 0 */)
       m_sampleFunction(0),
       m_data(0),
       m_dataLength(0),
+      m_dataOwnership(OwnedData),
+      m_mappedFile(0),
+      m_mapping(0),
       m_nofChannels(0),
       m_bitsPerSample(0),
       m_signedData(false),
-      m_samplesPerSec(0)
+      m_samplesPerSec(0),
+      m_blockAlign(0),
+      m_compressedFrames(0),
+      m_useCount(0)
 {
 }
 
@@ -66,24 +58,54 @@ AudioBuffer::AudioBuffer(QObject *parent /* = 0 */)
 */
 AudioBuffer::~AudioBuffer()
 {
+    if (m_useCount > 0) {
+        DEBUG_INFO("Warning: The buffer is still used by" << m_useCount
+                   << "voices!");
+    }
+
     // Deallocate the data.
     reallocate(0);
 }
 
 
 /*!
-  (Re)allocates the audio buffer according to \a length.
+  Marks the buffer to be in use. Called by the voices when they start
+  playing the buffer and by AudioBufferCache::buffer() for the caller, each
+  call must be paired with release(). A buffer in use is never evicted by
+  AudioBufferCache. Thread safe.
 */
-void AudioBuffer::reallocate(int length)
+void AudioBuffer::acquire()
 {
-    if (m_data) {
-        delete [] ((char*)m_data);
+    m_useCount.ref();
+}
+
+
+/*!
+  Releases a use marked with acquire(). Thread safe, the voices call this
+  from the audio thread when they finish.
+*/
+void AudioBuffer::release()
+{
+    if (m_useCount.fetchAndAddOrdered(-1) <= 0) {
+        DEBUG_INFO("Warning: Unbalanced release!");
+        m_useCount.ref(); // Undo
     }
+}
+
+
+/*!
+  (Re)allocates the audio buffer according to \a length. The data is aligned
+  to GEAudioBufferAlignment. The previous data is released, including a
+  mapping made with mapData().
+*/
+void AudioBuffer::reallocate(int length)
+{
+    releaseData();
 
     m_dataLength = length;
 
     if (m_dataLength > 0) {
-        m_data = new char[m_dataLength];
+        m_data = AudioKernels::allocateBuffer(m_dataLength);
     }
     else {
         m_data = 0;
@@ -91,214 +113,532 @@ void AudioBuffer::reallocate(int length)
 }
 
 
+/*!
+  Releases the data according to its ownership.
+*/
+void AudioBuffer::releaseData()
+{
+    if (m_dataOwnership == MappedData) {
+        if (m_mappedFile) {
+            m_mappedFile->unmap(m_mapping);
+            delete m_mappedFile;
+            m_mappedFile = 0;
+            m_mapping = 0;
+        }
+
+        m_dataOwnership = OwnedData;
+    }
+    else if (m_dataOwnership == SharedData) {
+        m_sharedData.clear();
+        m_dataOwnership = OwnedData;
+    }
+    else if (m_data) {
+        AudioKernels::freeBuffer(m_data);
+    }
+
+    m_data = 0;
+    m_dataLength = 0;
+}
+
+
+/*!
+  Uses \a length bytes from \a offset of the file with \a fileName as the
+  data by mapping the file into memory. No copy of the data is made, the
+  pages are loaded on demand and shared with the file cache. The mapping
+  is released with the buffer. Note that the mapped data is read-only.
+
+  Returns true if successful, false otherwise (for example, if the file is
+  a compressed resource).
+*/
+bool AudioBuffer::mapData(const QString &fileName, qint64 offset, int length)
+{
+    if (length <= 0)
+        return false;
+
+    QFile *file = new QFile(fileName);
+
+    if (!file->open(QIODevice::ReadOnly)) {
+        delete file;
+        return false;
+    }
+
+    uchar *mapping = file->map(offset, length);
+
+    // The mapping stays valid until unmapped or the file object is deleted.
+    file->close();
+
+    if (!mapping) {
+        DEBUG_INFO("Failed to map " << fileName);
+        delete file;
+        return false;
+    }
+
+    releaseData();
+    m_data = mapping;
+    m_dataLength = length;
+    m_dataOwnership = MappedData;
+    m_mappedFile = file;
+    m_mapping = mapping;
+    return true;
+}
+
+
+/*!
+  Returns the length of the data in frames, i.e. in samples per channel.
+*/
+int AudioBuffer::getFrameCount()
+{
+    if (isCompressed()) {
+        const int frames(AudioAdpcm::frameCount(m_dataLength, m_blockAlign,
+                                                m_nofChannels));
+
+        if (m_compressedFrames > 0)
+            return qMin(m_compressedFrames, frames);
+
+        return frames;
+    }
+
+    const int frameSize(getBytesPerSample() * m_nofChannels);
+    return (frameSize > 0) ? m_dataLength / frameSize : 0;
+}
+
+
+/*!
+  Returns the number of frames in a block of compressed data or 0 if the
+  data is not compressed.
+*/
+int AudioBuffer::getSamplesPerBlock()
+{
+    return AudioAdpcm::samplesPerBlock(m_blockAlign, m_nofChannels);
+}
+
+
+/*!
+  Decodes IMA ADPCM compressed data into 16-bit PCM, which takes four times
+  the memory. Returns true if successful or not compressed, false
+  otherwise.
+*/
+bool AudioBuffer::decompress()
+{
+    if (!isCompressed())
+        return true;
+
+    const int frames(getFrameCount());
+    const int blockFrames(getSamplesPerBlock());
+
+    if (!m_data || frames <= 0 || blockFrames <= 0)
+        return false;
+
+    // The last block is decoded in full, reserve room for it.
+    const int blocks((m_dataLength + m_blockAlign - 1) / m_blockAlign);
+    AUDIO_SAMPLE_TYPE *pcm = (AUDIO_SAMPLE_TYPE*)AudioKernels::allocateBuffer(
+        blocks * blockFrames * m_nofChannels * sizeof(AUDIO_SAMPLE_TYPE));
+
+    for (int block = 0; block < blocks; block++) {
+        const int offset(block * m_blockAlign);
+
+        AudioAdpcm::decodeBlock((const char*)m_data + offset,
+                                qMin(m_blockAlign, m_dataLength - offset),
+                                m_nofChannels,
+                                pcm + block * blockFrames * m_nofChannels);
+    }
+
+    const int channels(m_nofChannels);
+
+    releaseData();
+    m_data = pcm;
+    m_dataLength = frames * channels * sizeof(AUDIO_SAMPLE_TYPE);
+    m_bitsPerSample = AUDIO_SAMPLE_BITS;
+    m_blockAlign = 0;
+    m_compressedFrames = 0;
+    m_signedData = true;
+
+    return setSampleFunction(*this);
+}
+
+
+/*!
+  Returns true if the data is in the mixing format, interleaved stereo
+  AUDIO_SAMPLE_TYPE samples at AudioConfig::sampleRate(), false otherwise.
+*/
+bool AudioBuffer::isMixFormat() const
+{
+    return (m_bitsPerSample == AUDIO_SAMPLE_BITS && m_nofChannels == 2 &&
+            m_samplesPerSec == AudioConfig::sampleRate());
+}
+
+
+/*!
+  Converts the data into interleaved stereo AUDIO_SAMPLE_TYPE samples at the
+  mixing sample rate (AudioConfig::sampleRate()). Played at normal speed,
+  the converted buffer is mixed with a plain copy-with-gain instead of
+  converting and interpolating every sample. The conversion uses more memory
+  for 8-bit, mono and low rate data.
+
+  Returns true if successful or already in the mixing format, false
+  otherwise.
+*/
+bool AudioBuffer::convertToMixFormat()
+{
+    const int rate(AudioConfig::sampleRate());
+
+    if (isMixFormat()) {
+        // Already in the mixing format.
+        return true;
+    }
+
+    if (!decompress())
+        return false;
+
+    const int frameSize(getBytesPerSample() * m_nofChannels);
+
+    if (!m_data || frameSize <= 0 || m_samplesPerSec <= 0 ||
+        !AudioConverter::isSupported(m_bitsPerSample, m_nofChannels)) {
+        DEBUG_INFO("Cannot convert the buffer!");
+        return false;
+    }
+
+    const int frames(m_dataLength / frameSize);
+    AUDIO_SAMPLE_TYPE *stereo =
+        (AUDIO_SAMPLE_TYPE*)AudioKernels::allocateBuffer(
+            frames * 2 * sizeof(AUDIO_SAMPLE_TYPE));
+
+    AudioConverter::toStereo(m_data, frames, m_bitsPerSample, m_nofChannels,
+                             stereo);
+
+    int convertedFrames(frames);
+
+    if (m_samplesPerSec != rate) {
+        convertedFrames =
+            AudioConverter::resampledLength(frames, m_samplesPerSec, rate);
+
+        AUDIO_SAMPLE_TYPE *resampled =
+            (AUDIO_SAMPLE_TYPE*)AudioKernels::allocateBuffer(
+                convertedFrames * 2 * sizeof(AUDIO_SAMPLE_TYPE));
+
+        AudioConverter::resample(stereo, frames, m_samplesPerSec, rate,
+                                 resampled);
+        AudioKernels::freeBuffer(stereo);
+        stereo = resampled;
+    }
+
+    releaseData();
+    m_data = stereo;
+    m_dataLength = convertedFrames * 2 * sizeof(AUDIO_SAMPLE_TYPE);
+    m_nofChannels = 2;
+    m_bitsPerSample = AUDIO_SAMPLE_BITS;
+    m_samplesPerSec = rate;
+    m_signedData = true;
+
+    return setSampleFunction(*this);
+}
+
+
 /*!
   Loads a .wav file from file with \a fileName. Note that this method can be
   used for loading .wav from Qt resources as well. If \a parent is given, it
-  is set as the parent of the constructed buffer.
+  is set as the parent of the constructed buffer. If \a flags contains
+  ConvertToMixFormat, the data is converted with convertToMixFormat(). If
+  \a flags contains MemoryMap, the data is mapped directly from the file
+  when it can be played as is, otherwise it is read into memory.
+
+  The file is mapped or read at once and parsed with WavParser, see it for
+  the supported formats. 24 and 32-bit integer PCM is narrowed to 16 bits.
+  Uncompressed resources are used in place, without copying.
+
+  In addition to PCM, IMA ADPCM compressed files are supported. They are
+  kept compressed, ConvertToMixFormat is ignored for them, and decoded
+  while mixing. See AudioAdpcm::encodeWav() for converting the assets.
 
   Returns a new buffer if successful, NULL otherwise.
 */
-AudioBuffer *AudioBuffer::loadWav(QString fileName, QObject *parent /* = 0 */)
+AudioBuffer *AudioBuffer::loadWav(QString fileName,
+                                  QObject *parent /* = 0 */,
+                                  LoadFlags flags /* = NoLoadFlags */)
 {
-    QFile wavFile(fileName);
+    if (fileName.startsWith(QLatin1Char(':'))) {
+        QResource resource(fileName);
+
+        if (resource.isValid() && !resource.isCompressed()) {
+            // The resource data stays in memory, no need to copy it.
+            const QByteArray data(QByteArray::fromRawData(
+                (const char*)resource.data(), (int)resource.size()));
+            return loadWavData(data, parent, flags);
+        }
+    }
+
+    QFile *wavFile = new QFile(fileName);
 
-    if (wavFile.open(QIODevice::ReadOnly)) {
-        AudioBuffer *buffer = loadWav(wavFile, parent);
+    if (wavFile->open(QIODevice::ReadOnly)) {
+        AudioBuffer *buffer = loadWav(wavFile, parent, flags);
 
         if (!buffer) {
             DEBUG_INFO("Failed to load data from " << fileName << "!");
         }
 
-        wavFile.close();
         return buffer;
     }
 
-    DEBUG_INFO("Failed to open " << fileName << ": " << wavFile.errorString());
+    DEBUG_INFO("Failed to open " << fileName << ": " << wavFile->errorString());
+    delete wavFile;
     return 0;
 }
 
 
 /*!
-  Protected method, called from AudioBuffer::loadWav(QString, QObject*).
-
-  Loads a .wav file from a preopened \a wavFile. If \a parent is given, it is
-  set as the parent of the constructed buffer.
+  Loads a .wav file from \a data, for example the contents of a Qt resource
+  or an AssetArchive entry. The data is used in place when it can be played
+  as is or converted directly; the buffer then keeps a reference to
+  \a data, so a QByteArray::fromRawData() array must stay valid as long as
+  the buffer. If \a parent is given, it is set as the parent of the
+  constructed buffer.
+  See loadWav(QString, QObject*, LoadFlags) for \a flags.
 
   Returns a new buffer if successful, NULL otherwise.
 */
-AudioBuffer *AudioBuffer::loadWav(QFile &wavFile, QObject *parent /* = 0 */)
+AudioBuffer *AudioBuffer::loadWavData(const QByteArray &data,
+                                      QObject *parent /* = 0 */,
+                                      LoadFlags flags /* = NoLoadFlags */)
 {
-    if (!wavFile.isOpen()) {
-        // The file is not open!
-        DEBUG_INFO("The given file must be opened before calling this method!");
-        return 0;
-    }
+    WavParser wav;
 
-    SWavHeader header;
+    if (!wav.parse(data.constData(), data.size()))
+        return 0;
 
-    wavFile.read(header.chunkID, 4);
+    const bool convert((flags & ConvertToMixFormat) &&
+                       wav.audioFormat() != GEWavFormatImaAdpcm);
+    AudioBuffer *buffer = createBuffer(wav, parent);
 
-    if (header.chunkID[0] != 'R' || header.chunkID[1] != 'I' ||
-        header.chunkID[2] != 'F' || header.chunkID[3] != 'F') {
-        // Incorrect header
+    if (!buffer)
         return 0;
-    }
 
-    wavFile.read((char*)&header.chunkSize, 4);
-    wavFile.read((char*)&header.format, 4);
+    const char *source = data.constData() + wav.dataOffset();
 
-    if (header.format[0] != 'W' || header.format[1] != 'A' ||
-        header.format[2] != 'V' || header.format[3] != 'E') {
-        // Incorrect header
-        return 0;
+    if (buffer->canUseInPlace(wav, source)) {
+        buffer->m_data = (void*)source;
+        buffer->m_dataLength = (int)wav.dataLength();
+        buffer->m_dataOwnership = SharedData;
+        buffer->m_sharedData = data;
     }
+    else {
+        buffer->setWavData(wav, source);
+    }
+
+    return buffer->finishLoading(convert);
+}
 
-    wavFile.read((char*)&header.subchunk1id, 4);
 
-    if (header.subchunk1id[0] != 'f' || header.subchunk1id[1] != 'm' ||
-        header.subchunk1id[2] != 't' || header.subchunk1id[3] != ' ') {
-        // Incorrect header
-        return 0;
-    }
+/*!
+  Protected method, called from
+  AudioBuffer::loadWav(QString, QObject*, LoadFlags).
 
-    wavFile.read((char*)&header.subchunk1size, 4);
-    wavFile.read((char*)&header.audioFormat, 2);
-    wavFile.read((char*)&header.nofChannels, 2);
-    wavFile.read((char*)&header.sampleRate, 4);
-    wavFile.read((char*)&header.byteRate, 4);
-    wavFile.read((char*)&header.blockAlign, 2);
-    wavFile.read((char*)&header.bitsPerSample, 2);
+  Loads a .wav file from a preopened \a wavFile. The file is mapped into
+  memory, or read at once if it cannot be mapped. Takes the ownership of
+  \a wavFile: the buffer keeps it if the mapped data is used, otherwise it
+  is deleted. If \a parent is given, it is set as the parent of the
+  constructed buffer.
+  See loadWav(QString, QObject*, LoadFlags) for \a flags.
 
-    while (1) {
-        if (wavFile.read((char*)&header.subchunk2id, 4) != 4)
-            return 0;
+  Returns a new buffer if successful, NULL otherwise.
+*/
+AudioBuffer *AudioBuffer::loadWav(QFile *wavFile,
+                                  QObject *parent /* = 0 */,
+                                  LoadFlags flags /* = NoLoadFlags */)
+{
+    if (!wavFile || !wavFile->isOpen()) {
+        // The file is not open!
+        DEBUG_INFO("The given file must be opened before calling this method!");
+        delete wavFile;
+        return 0;
+    }
 
-        if (wavFile.read((char*)&header.subchunk2size, 4) != 4)
-            return 0;
+    const qint64 size(wavFile->size());
+    uchar *mapping = (size > 0 && size <= INT_MAX) ?
+        wavFile->map(0, size) : 0;
 
-        if (header.subchunk2id[0] == 'd' && header.subchunk2id[1] == 'a' &&
-            header.subchunk2id[2] == 't' && header.subchunk2id[3] == 'a') {
-            // Found the data chunk.
-            break;
-        }
+    if (!mapping) {
+        // For example a compressed resource, read it at once.
+        const QByteArray data(wavFile->readAll());
+        delete wavFile;
+        return loadWavData(data, parent, flags);
+    }
 
-        // This was not the data-chunk. Skip it.
-        if (header.subchunk2size < 1) {
-            // Error in file!
-            return 0;
-        }
+    WavParser wav;
+    AudioBuffer *buffer(0);
+    bool convert(false);
 
-        char *unused = new char[header.subchunk2size];
-        wavFile.read(unused, header.subchunk2size);
-        delete [] unused;
+    if (wav.parse((const char*)mapping, size)) {
+        convert = ((flags & ConvertToMixFormat) &&
+                   wav.audioFormat() != GEWavFormatImaAdpcm);
+        buffer = createBuffer(wav, parent);
     }
 
-    // The data follows.
-    if (header.subchunk2size < 1)
+    if (!buffer) {
+        wavFile->unmap(mapping);
+        delete wavFile;
         return 0;
+    }
 
-    // Construct the buffer.
-    AudioBuffer *buffer = new AudioBuffer(parent);
-
-    buffer->m_nofChannels = header.nofChannels;
-    buffer->m_bitsPerSample = header.bitsPerSample;
-    buffer->m_samplesPerSec = header.sampleRate;
-    buffer->m_signedData = 0; // Where to look for this?
-    buffer->reallocate(header.subchunk2size);
+    const char *source = (const char*)mapping + wav.dataOffset();
 
-    wavFile.read((char*)buffer->m_data, header.subchunk2size);
+    // The mapping is kept if requested, or if the data will be converted
+    // anyway, which then reads it only once.
+    if (buffer->canUseInPlace(wav, source) &&
+        ((flags & MemoryMap) || (convert && !buffer->isMixFormat()))) {
+        buffer->m_data = (void*)source;
+        buffer->m_dataLength = (int)wav.dataLength();
+        buffer->m_dataOwnership = MappedData;
+        buffer->m_mappedFile = wavFile;
+        buffer->m_mapping = mapping;
 
-    // Select a good sampling function.
-    if (!setSampleFunction(*buffer)) {
-        // Failed to resolve the sample function!
-        delete buffer;
-        return 0;
+        // The mapping stays valid after closing.
+        wavFile->close();
+    }
+    else {
+        buffer->setWavData(wav, source);
+        wavFile->unmap(mapping);
+        delete wavFile;
     }
 
-    return buffer;
+    return buffer->finishLoading(convert);
 }
 
 
 /*!
-  Loads a .wav file from a preopened file handle, \a wavFile. If \a parent is
-  given, it is set as the parent of the constructed buffer.
+  Loads a .wav file from a preopened file handle, \a wavFile. The rest of
+  the file is read at once. If \a parent is given, it is set as the parent
+  of the constructed buffer. See loadWav(QString, QObject*, LoadFlags) for
+  \a flags.
 
   Returns a new buffer if successful, NULL otherwise.
 */
-AudioBuffer *AudioBuffer::loadWav(FILE *wavFile, QObject *parent /* = 0 */)
+AudioBuffer *AudioBuffer::loadWav(FILE *wavFile,
+                                  QObject *parent /* = 0 */,
+                                  LoadFlags flags /* = NoLoadFlags */)
 {
     if (!wavFile) {
         // Invalid file handle!
         return 0;
     }
 
-    // Read the header.
-    SWavHeader header;
-
-    fread(header.chunkID, 4, 1, wavFile);
+    const long start(ftell(wavFile));
 
-    if (header.chunkID[0] != 'R' || header.chunkID[1] != 'I' ||
-        header.chunkID[2] != 'F' || header.chunkID[3] != 'F') {
-        // Incorrect header
+    if (start < 0 || fseek(wavFile, 0, SEEK_END) != 0)
         return 0;
-    }
 
-    fread(&header.chunkSize, 4, 1, wavFile);
-    fread(header.format, 4, 1, wavFile);
+    const long size(ftell(wavFile) - start);
 
-    if (header.format[0] != 'W' || header.format[1] != 'A' ||
-        header.format[2] != 'V' || header.format[3] != 'E') {
-        // Incorrect header
+    if (size <= 0 || fseek(wavFile, start, SEEK_SET) != 0)
         return 0;
-    }
 
-    fread(header.subchunk1id, 4, 1, wavFile);
+    QByteArray data;
+    data.resize((int)size);
 
-    if (header.subchunk1id[0] != 'f' || header.subchunk1id[1] != 'm' ||
-        header.subchunk1id[2] != 't' || header.subchunk1id[3] != ' ') {
-        // Incorrect header
+    if (fread(data.data(), 1, size, wavFile) != (size_t)size) {
+        DEBUG_INFO("Failed to read the file!");
         return 0;
     }
 
-    fread(&header.subchunk1size, 4, 1, wavFile);
-    fread(&header.audioFormat, 2, 1, wavFile);
-    fread(&header.nofChannels, 2, 1, wavFile);
-    fread(&header.sampleRate, 4, 1, wavFile);
-    fread(&header.byteRate, 4, 1, wavFile);
-    fread(&header.blockAlign, 2, 1, wavFile);
-    fread(&header.bitsPerSample, 2, 1, wavFile);
-    fread(header.subchunk2id, 4, 1, wavFile);
+    return loadWavData(data, parent, flags);
+}
 
-    if (header.subchunk2id[0] != 'd' || header.subchunk2id[1] != 'a' ||
-        header.subchunk2id[2] != 't' || header.subchunk2id[3] != 'a') {
-        // Incorrect header
+
+/*!
+  Constructs a buffer with the format parsed by \a wav and \a parent as the
+  parent. Returns the buffer or NULL if the format is not supported.
+*/
+AudioBuffer *AudioBuffer::createBuffer(const WavParser &wav, QObject *parent)
+{
+    if (!wav.isSupported())
         return 0;
-    }
 
-    fread(&header.subchunk2size, 4, 1, wavFile);
+    const bool compressed(wav.audioFormat() == GEWavFormatImaAdpcm);
 
-    // The data follows.
-    if (header.subchunk2size < 1)
+    if (compressed &&
+        AudioAdpcm::samplesPerBlock(wav.blockAlign(), wav.nofChannels()) <= 1) {
+        DEBUG_INFO("Invalid IMA ADPCM format!");
         return 0;
+    }
 
     AudioBuffer *buffer = new AudioBuffer(parent);
 
-    buffer->m_nofChannels = header.nofChannels;
-    buffer->m_bitsPerSample = header.bitsPerSample;
-    buffer->m_samplesPerSec = header.sampleRate;
-    buffer->m_signedData = 0; // Where to look for this?
-    buffer->reallocate(header.subchunk2size);
+    buffer->m_nofChannels = wav.nofChannels();
+    buffer->m_bitsPerSample =
+        wav.needsNarrowing() ? AUDIO_SAMPLE_BITS : wav.bitsPerSample();
+    buffer->m_samplesPerSec = wav.samplesPerSec();
+    buffer->m_signedData = (wav.bitsPerSample() > 8);
+
+    if (compressed) {
+        // Compressed data is kept as is.
+        buffer->m_blockAlign = wav.blockAlign();
+        buffer->m_compressedFrames = wav.factFrames();
+    }
+
+    return buffer;
+}
+
+
+/*!
+  Returns true if the data parsed by \a wav can be used from \a source
+  without copying, i.e. it needs no narrowing and the samples are aligned,
+  false otherwise.
+*/
+bool AudioBuffer::canUseInPlace(const WavParser &wav, const char *source) const
+{
+    return (!wav.needsNarrowing() && ((quintptr)source % 4) == 0);
+}
+
+
+/*!
+  Copies the data parsed by \a wav from \a source into memory owned by the
+  buffer. 24 and 32-bit integer PCM is narrowed to 16 bits.
+*/
+void AudioBuffer::setWavData(const WavParser &wav, const char *source)
+{
+    if (wav.needsNarrowing()) {
+        const int samples((int)(wav.dataLength() / (wav.bitsPerSample() / 8)));
+
+        reallocate(samples * sizeof(AUDIO_SAMPLE_TYPE));
+        AudioConverter::toPcm16(source, samples, wav.bitsPerSample(),
+                                (AUDIO_SAMPLE_TYPE*)m_data);
+    }
+    else {
+        reallocate((int)wav.dataLength());
+        memcpy(m_data, source, m_dataLength);
+    }
+}
 
-    fread(buffer->m_data, 1, header.subchunk2size, wavFile);
 
+/*!
+  Selects the sample function of the loaded buffer and converts it to the
+  mixing format if \a convert is true. Returns the buffer or NULL if the
+  buffer cannot be played, in which case the buffer is deleted.
+*/
+AudioBuffer *AudioBuffer::finishLoading(bool convert)
+{
     // Select a good sampling function.
-    if (!setSampleFunction(*buffer)) {
-        // Failed to select the sampling function!
-        delete buffer;
+    if (!setSampleFunction(*this)) {
+        // Failed to resolve the sample function!
+        delete this;
         return 0;
     }
 
-    return buffer;
+    // The voices decode the blocks into a cache of a fixed size.
+    if (isCompressed() &&
+        m_blockAlign > GEMaxAdpcmBlockAlign * m_nofChannels) {
+        DEBUG_INFO("The blocks are too large to decode while mixing.");
+
+        if (!decompress()) {
+            delete this;
+            return 0;
+        }
+    }
+
+    if (convert && !convertToMixFormat()) {
+        DEBUG_INFO("Failed to convert, using the original format.");
+    }
+
+    return this;
 }
 
 
@@ -337,8 +677,9 @@ AUDIO_SAMPLE_TYPE AudioBuffer::sampleFunction8bitStereo(AudioBuffer *buffer,
                                                          int pos,
                                                          int channel)
 {
-    return ((AUDIO_SAMPLE_TYPE)
-        (((quint8*)(buffer->m_data))[pos * buffer->m_nofChannels + channel]) << 8);
+    return (AUDIO_SAMPLE_TYPE)
+        ((((quint8*)(buffer->m_data))[pos * buffer->m_nofChannels + channel] -
+          128) << 8);
 }
 
 
@@ -360,6 +701,23 @@ AUDIO_SAMPLE_TYPE AudioBuffer::sampleFunction32bitStereo(AudioBuffer *buffer,
 }
 
 
+// Compressed version, decodes the block up to the sample on every call.
+
+AUDIO_SAMPLE_TYPE AudioBuffer::sampleFunctionImaAdpcm(AudioBuffer *buffer,
+                                                       int pos,
+                                                       int channel)
+{
+    const int blockFrames(buffer->getSamplesPerBlock());
+    const int block(pos / blockFrames);
+
+    return AudioAdpcm::decodeSample(
+        (const char*)buffer->m_data + block * buffer->m_blockAlign,
+        buffer->m_nofChannels,
+        qMin(channel, buffer->m_nofChannels - 1),
+        pos % blockFrames);
+}
+
+
 /*!
   Constructs a new play instance and sets it as an audio source for \a mixer.
   Note that the mixer takes ownership of the constructed instance.
@@ -380,6 +738,22 @@ AudioBufferPlayInstance *AudioBuffer::playWithMixer(AudioMixer &mixer)
 }
 
 
+/*!
+  Plays the buffer in a preallocated voice of \a pool. Unlike
+  playWithMixer(), no memory is allocated and no objects are created.
+
+  Returns the handle of the voice or GEInvalidVoiceHandle if all the voices
+  of the pool are in use.
+*/
+quint32 AudioBuffer::playWithPool(AudioVoicePool &pool,
+                                  float volume /* = 1.0f */,
+                                  float speed /* = 1.0f */,
+                                  int loopCount /* = 0 */)
+{
+    return pool.play(this, volume, speed, loopCount);
+}
+
+
 /*!
   Sets an appropriate sample function for \a buffer depending on the number of
   channels and the bit rate.
@@ -390,7 +764,11 @@ bool AudioBuffer::setSampleFunction(AudioBuffer &buffer)
 {
     buffer.m_sampleFunction = 0;
 
-    if (buffer.m_nofChannels == 1) {
+    if (buffer.isCompressed()) {
+        if (buffer.m_nofChannels == 1 || buffer.m_nofChannels == 2)
+            buffer.m_sampleFunction = sampleFunctionImaAdpcm;
+    }
+    else if (buffer.m_nofChannels == 1) {
         if (buffer.m_bitsPerSample == 8)
             buffer.m_sampleFunction = sampleFunction8bitMono;
 
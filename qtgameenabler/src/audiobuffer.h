@@ -7,6 +7,8 @@
 #ifndef GEAUDIOBUFFER_H
 #define GEAUDIOBUFFER_H
 
+#include <QAtomicInt>
+#include <QByteArray>
 #include "audiosourceif.h"
 
 // Forward declarations
@@ -19,6 +21,8 @@ namespace GE {
 class AudioBuffer;
 class AudioBufferPlayInstance;
 class AudioMixer;
+class AudioVoicePool;
+class WavParser;
 
 // Prototype function for audio sampling
 typedef AUDIO_SAMPLE_TYPE(*SAMPLE_FUNCTION_TYPE)(AudioBuffer *buffer,
@@ -28,14 +32,48 @@ typedef AUDIO_SAMPLE_TYPE(*SAMPLE_FUNCTION_TYPE)(AudioBuffer *buffer,
 
 class AudioBuffer : public QObject
 {
+public: // Data types
+
+    enum LoadFlag {
+        NoLoadFlags = 0x0,
+        ConvertToMixFormat = 0x1, // Convert to the mixing format and rate
+        MemoryMap = 0x2 // Map the data from the file instead of copying it
+    };
+
+    Q_DECLARE_FLAGS(LoadFlags, LoadFlag)
+
+    enum DataOwnership {
+        OwnedData = 0, // Allocated by the buffer
+        MappedData = 1, // Mapped from m_mappedFile, read-only
+        SharedData = 2 // Points into m_sharedData, read-only
+    };
+
 public:
     explicit AudioBuffer(QObject *parent = 0);
     virtual ~AudioBuffer();
-    static AudioBuffer *loadWav(QString fileName, QObject *parent = 0);
-    static AudioBuffer *loadWav(FILE *wavFile, QObject *parent = 0);
+    static AudioBuffer *loadWav(QString fileName,
+                                QObject *parent = 0,
+                                LoadFlags flags = NoLoadFlags);
+    static AudioBuffer *loadWav(FILE *wavFile,
+                                QObject *parent = 0,
+                                LoadFlags flags = NoLoadFlags);
+    static AudioBuffer *loadWavData(const QByteArray &data,
+                                    QObject *parent = 0,
+                                    LoadFlags flags = NoLoadFlags);
 
 public:
     void reallocate(int length);
+    bool mapData(const QString &fileName, qint64 offset, int length);
+    bool isMixFormat() const;
+    bool convertToMixFormat();
+    inline bool isCompressed() const { return (m_blockAlign > 0); }
+    bool decompress();
+    inline DataOwnership dataOwnership() const { return m_dataOwnership; }
+
+    // Use counting, see AudioBufferCache
+    void acquire();
+    void release();
+    inline int useCount() const { return m_useCount; }
 
     // Getters for raw sample data and sample details
     inline void* getRawData() { return m_data; }
@@ -44,6 +82,9 @@ public:
     inline int getBitsPerSample() { return m_bitsPerSample; }
     inline int getSamplesPerSec() { return m_samplesPerSec; }
     inline short getNofChannels() { return m_nofChannels; }
+    inline int getBlockAlign() { return m_blockAlign; }
+    int getFrameCount();
+    int getSamplesPerBlock();
     inline SAMPLE_FUNCTION_TYPE getSampleFunction() { return m_sampleFunction; }
 
     // Static implementations of sample functions
@@ -59,23 +100,45 @@ public:
         AudioBuffer *buffer, int pos, int channel);
     static AUDIO_SAMPLE_TYPE sampleFunction32bitStereo(
         AudioBuffer *buffer, int pos, int channel);
+    static AUDIO_SAMPLE_TYPE sampleFunctionImaAdpcm(
+        AudioBuffer *buffer, int pos, int channel);
 
     AudioBufferPlayInstance *playWithMixer(GE::AudioMixer &mixer);
+    quint32 playWithPool(GE::AudioVoicePool &pool,
+                         float volume = 1.0f,
+                         float speed = 1.0f,
+                         int loopCount = 0);
 
 protected:
-    static AudioBuffer *loadWav(QFile &wavFile, QObject *parent = 0);
+    static AudioBuffer *loadWav(QFile *wavFile,
+                                QObject *parent = 0,
+                                LoadFlags flags = NoLoadFlags);
+    static AudioBuffer *createBuffer(const WavParser &wav, QObject *parent);
     static bool setSampleFunction(AudioBuffer &buffer);
+    bool canUseInPlace(const WavParser &wav, const char *source) const;
+    void setWavData(const WavParser &wav, const char *source);
+    AudioBuffer *finishLoading(bool convert);
+    void releaseData();
 
 protected: // Data
     SAMPLE_FUNCTION_TYPE m_sampleFunction;
-    void *m_data; // Owned
+    void *m_data; // Owned, see m_dataOwnership
     int m_dataLength; // In bytes
+    DataOwnership m_dataOwnership;
+    QFile *m_mappedFile; // Owned, with MappedData only
+    uchar *m_mapping; // The start of the mapping, with MappedData only
+    QByteArray m_sharedData; // With SharedData only
     short m_nofChannels;
     short m_bitsPerSample;
     bool m_signedData;
     int m_samplesPerSec;
+    int m_blockAlign; // In bytes, for IMA ADPCM data only
+    int m_compressedFrames; // From the fact chunk, 0 if not known
+    QAtomicInt m_useCount; // The voices playing the buffer and other users
 };
 
 } // namespace GE
 
+Q_DECLARE_OPERATORS_FOR_FLAGS(GE::AudioBuffer::LoadFlags)
+
 #endif // GEAUDIOBUFFER_H
@@ -0,0 +1,259 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#include "audiobuffercache.h"
+#include <QPair>
+#include <QVector>
+#include <QtAlgorithms>
+#include "assetarchive.h"
+#include "trace.h" // For debug macros
+
+using namespace GE;
+
+
+/*!
+  \class AudioBufferCache
+  \brief Loads audio buffers once and keeps them resident within a memory
+         budget.
+
+  The buffers are keyed by the file name, which may also be a Qt resource
+  path. Requesting a buffer already in the cache returns the same buffer
+  without touching the file. The buffers are owned by the cache.
+
+  Every buffer returned by buffer() is marked in use for the caller with
+  AudioBuffer::acquire(), and the caller must call AudioBuffer::release()
+  once it no longer keeps the pointer. The buffers can therefore be
+  requested up front, for example in GameWindow::onCreate(), and played
+  later.
+
+  When the total size of the buffers exceeds budget(), the buffers not in
+  use (see AudioBuffer::useCount()), that is, released by the callers and
+  not played by any voice, are evicted, the least recently requested first.
+  The buffers in use are never evicted, so the budget may be exceeded
+  temporarily.
+
+  The statistics can be used to size the budget for a device class. The
+  cache must be used from a single thread.
+
+  If an archive is set with setArchive(), the names found in it are loaded
+  from the archive without copying (see AssetArchive) and the other names
+  from the files.
+*/
+
+
+/*!
+  Constructor. \a budget is the maximum size of the resident buffers in
+  bytes.
+*/
+AudioBufferCache::AudioBufferCache(
+        qint64 budget /* = GEDefaultAudioCacheBudget */,
+        QObject *parent /* = 0 */)
+    : QObject(parent),
+      m_archive(0),
+      m_useStamp(0),
+      m_budget(budget),
+      m_residentBytes(0),
+      m_peakResidentBytes(0),
+      m_hitCount(0),
+      m_missCount(0),
+      m_evictedCount(0),
+      m_evictedBytes(0)
+{
+}
+
+
+/*!
+  Destructor. Deletes all the buffers, the voices playing them must have
+  been stopped.
+*/
+AudioBufferCache::~AudioBufferCache()
+{
+    QHash<QString, CacheEntry>::iterator i = m_entries.begin();
+
+    while (i != m_entries.end()) {
+        delete i.value().buffer;
+        ++i;
+    }
+}
+
+
+/*!
+  Returns the buffer loaded from \a fileName, loading it with \a flags if it
+  is not in the cache yet (see AudioBuffer::loadWav()). The flags are
+  ignored if the buffer is already resident. Evicts idle buffers if the
+  budget is exceeded.
+
+  The returned buffer is marked in use and is not evicted until the caller
+  calls AudioBuffer::release() on it, once per call of this method.
+
+  Returns NULL if the file could not be loaded.
+*/
+AudioBuffer *AudioBufferCache::buffer(
+        const QString &fileName,
+        AudioBuffer::LoadFlags flags /* = AudioBuffer::NoLoadFlags */)
+{
+    m_useStamp++;
+
+    QHash<QString, CacheEntry>::iterator i = m_entries.find(fileName);
+
+    if (i != m_entries.end()) {
+        m_hitCount++;
+        i.value().lastUse = m_useStamp;
+        i.value().buffer->acquire();
+        return i.value().buffer;
+    }
+
+    m_missCount++;
+
+    AudioBuffer *buffer(0);
+
+    if (m_archive && m_archive->contains(fileName)) {
+        buffer = AudioBuffer::loadWavData(m_archive->data(fileName), this,
+                                          flags);
+    }
+    else {
+        buffer = AudioBuffer::loadWav(fileName, this, flags);
+    }
+
+    if (!buffer) {
+        DEBUG_INFO("Failed to load" << fileName);
+        return 0;
+    }
+
+    // Mark in use for the caller before trimming.
+    buffer->acquire();
+
+    CacheEntry entry;
+    entry.buffer = buffer;
+    entry.lastUse = m_useStamp;
+    m_entries.insert(fileName, entry);
+
+    m_residentBytes += buffer->getDataLength();
+    m_peakResidentBytes = qMax(m_peakResidentBytes, m_residentBytes);
+
+    if (m_residentBytes > m_budget)
+        trim();
+
+    return buffer;
+}
+
+
+/*!
+  Returns true if the buffer of \a fileName is resident, false otherwise.
+*/
+bool AudioBufferCache::contains(const QString &fileName) const
+{
+    return m_entries.contains(fileName);
+}
+
+
+/*!
+  Evicts the buffer of \a fileName unless it is in use. Returns true if the
+  buffer was evicted, false otherwise.
+*/
+bool AudioBufferCache::remove(const QString &fileName)
+{
+    QHash<QString, CacheEntry>::const_iterator i =
+        m_entries.constFind(fileName);
+
+    if (i == m_entries.constEnd() || i.value().buffer->useCount() > 0)
+        return false;
+
+    evict(fileName);
+    return true;
+}
+
+
+/*!
+  Sets the memory budget to \a bytes and evicts idle buffers if it is
+  exceeded.
+*/
+void AudioBufferCache::setBudget(qint64 bytes)
+{
+    m_budget = bytes;
+
+    if (m_residentBytes > m_budget)
+        trim();
+}
+
+
+/*!
+  Resets the hit, miss and eviction counters and the peak resident size.
+*/
+void AudioBufferCache::resetStatistics()
+{
+    m_peakResidentBytes = m_residentBytes;
+    m_hitCount = 0;
+    m_missCount = 0;
+    m_evictedCount = 0;
+    m_evictedBytes = 0;
+}
+
+
+/*!
+  Evicts idle buffers, the least recently requested first, until the
+  resident buffers fit in the budget. Returns the number of buffers evicted.
+*/
+int AudioBufferCache::trim()
+{
+    // Sort the idle buffers by the time of the last request.
+    QVector<QPair<quint64, QString> > idle;
+    QHash<QString, CacheEntry>::const_iterator i = m_entries.constBegin();
+
+    while (i != m_entries.constEnd()) {
+        if (i.value().buffer->useCount() == 0)
+            idle.append(qMakePair(i.value().lastUse, i.key()));
+
+        ++i;
+    }
+
+    qSort(idle.begin(), idle.end());
+
+    int evicted(0);
+
+    while (m_residentBytes > m_budget && evicted < idle.count()) {
+        evict(idle[evicted].second);
+        evicted++;
+    }
+
+    return evicted;
+}
+
+
+/*!
+  Evicts all the idle buffers. Returns the number of buffers evicted.
+*/
+int AudioBufferCache::clear()
+{
+    const QList<QString> fileNames(m_entries.keys());
+    int evicted(0);
+
+    for (int i = 0; i < fileNames.count(); i++) {
+        if (m_entries.value(fileNames[i]).buffer->useCount() == 0) {
+            evict(fileNames[i]);
+            evicted++;
+        }
+    }
+
+    return evicted;
+}
+
+
+/*!
+  Deletes the buffer of \a fileName and updates the statistics.
+*/
+void AudioBufferCache::evict(const QString &fileName)
+{
+    const CacheEntry entry(m_entries.take(fileName));
+    const int bytes(entry.buffer->getDataLength());
+
+    DEBUG_INFO("Evicting" << fileName << "," << bytes << "bytes");
+
+    m_residentBytes -= bytes;
+    m_evictedCount++;
+    m_evictedBytes += bytes;
+    delete entry.buffer;
+}
@@ -0,0 +1,85 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#ifndef GEAUDIOBUFFERCACHE_H
+#define GEAUDIOBUFFERCACHE_H
+
+#include <QHash>
+#include <QObject>
+#include <QString>
+#include "audiobuffer.h"
+
+
+namespace GE {
+
+// Forward declarations
+class AssetArchive;
+
+// Constants
+const qint64 GEDefaultAudioCacheBudget(8 * 1024 * 1024); // In bytes
+
+
+class AudioBufferCache : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AudioBufferCache(qint64 budget = GEDefaultAudioCacheBudget,
+                              QObject *parent = 0);
+    virtual ~AudioBufferCache();
+
+public:
+    AudioBuffer *buffer(const QString &fileName,
+                        AudioBuffer::LoadFlags flags =
+                            AudioBuffer::NoLoadFlags);
+    bool contains(const QString &fileName) const;
+    bool remove(const QString &fileName);
+
+    void setBudget(qint64 bytes);
+    inline qint64 budget() const { return m_budget; }
+    inline void setArchive(const AssetArchive *archive) { m_archive = archive; }
+    inline const AssetArchive *archive() const { return m_archive; }
+
+    // Statistics
+    inline int residentCount() const { return m_entries.count(); }
+    inline qint64 residentBytes() const { return m_residentBytes; }
+    inline qint64 peakResidentBytes() const { return m_peakResidentBytes; }
+    inline int hitCount() const { return m_hitCount; }
+    inline int missCount() const { return m_missCount; }
+    inline int evictedCount() const { return m_evictedCount; }
+    inline qint64 evictedBytes() const { return m_evictedBytes; }
+    void resetStatistics();
+
+public slots:
+    int trim();
+    int clear();
+
+protected: // Data types
+
+    struct CacheEntry {
+        AudioBuffer *buffer; // Owned
+        quint64 lastUse; // The value of m_useStamp when last requested
+    };
+
+protected:
+    void evict(const QString &fileName);
+
+protected: // Data
+    QHash<QString, CacheEntry> m_entries;
+    const AssetArchive *m_archive; // Not owned, may be NULL
+    quint64 m_useStamp;
+    qint64 m_budget;
+    qint64 m_residentBytes;
+    qint64 m_peakResidentBytes;
+    int m_hitCount;
+    int m_missCount;
+    int m_evictedCount;
+    qint64 m_evictedBytes;
+};
+
+} // namespace GE
+
+#endif // GEAUDIOBUFFERCACHE_H
@@ -0,0 +1,196 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#include "audiobufferloader.h"
+#include <QFutureWatcher>
+#include <QThread>
+#include <QtConcurrentRun>
+#include "assetarchive.h"
+#include "audioconfig.h"
+#include "trace.h" // For debug macros
+
+using namespace GE;
+
+
+/*!
+  \class AudioBufferLoader
+  \brief Loads .wav files into audio buffers in parallel on the global
+         QThreadPool.
+
+  Each file is decoded in its own task, so a batch of files is loaded using
+  all the CPU cores while the calling thread keeps running. The returned
+  futures become ready when the buffers have been loaded; the result is
+  NULL if a file could not be loaded. The loaded buffers are moved to the
+  thread which called load() and are owned by the caller.
+
+  The loaded() and progress() signals are emitted in the thread of the
+  loader as the files complete, for example to drive a loading screen, and
+  finished() once all the pending files have been loaded.
+
+  If an archive is set with setArchive(), the names found in it are loaded
+  from the archive and the other names from the files. The archive must
+  stay open while loading and as long as the buffers are used.
+*/
+
+
+/*!
+  Constructor.
+*/
+AudioBufferLoader::AudioBufferLoader(QObject *parent /* = 0 */)
+    : QObject(parent),
+      m_archive(0),
+      m_loadedCount(0),
+      m_totalCount(0)
+{
+}
+
+
+/*!
+  Destructor. Waits for the pending loads to complete without emitting any
+  signals. The buffers stay available through the futures.
+*/
+AudioBufferLoader::~AudioBufferLoader()
+{
+    QHash<QObject*, QString>::const_iterator i = m_pending.constBegin();
+
+    while (i != m_pending.constEnd()) {
+        QObject *watcher = i.key();
+        static_cast<QFutureWatcher<AudioBuffer*>*>(watcher)->waitForFinished();
+        ++i;
+    }
+}
+
+
+/*!
+  Starts loading \a fileName with \a flags, see AudioBuffer::loadWav().
+  Returns a future for the buffer.
+*/
+QFuture<AudioBuffer*> AudioBufferLoader::load(
+        const QString &fileName,
+        AudioBuffer::LoadFlags flags /* = AudioBuffer::NoLoadFlags */)
+{
+    if (flags & AudioBuffer::ConvertToMixFormat) {
+        // Resolve the mixing rate here, not in several workers at once.
+        AudioConfig::sampleRate();
+    }
+
+    QFuture<AudioBuffer*> future =
+        QtConcurrent::run(loadInThread, fileName, flags, m_archive, thread());
+
+    QFutureWatcher<AudioBuffer*> *watcher =
+        new QFutureWatcher<AudioBuffer*>(this);
+    connect(watcher, SIGNAL(finished()), this, SLOT(loadFinished()));
+    watcher->setFuture(future);
+
+    m_pending.insert(watcher, fileName);
+    m_totalCount++;
+
+    return future;
+}
+
+
+/*!
+  For convenience.
+
+  Starts loading all the \a fileNames with \a flags. Returns the futures in
+  the order of the file names.
+*/
+QList<QFuture<AudioBuffer*> > AudioBufferLoader::load(
+        const QStringList &fileNames,
+        AudioBuffer::LoadFlags flags /* = AudioBuffer::NoLoadFlags */)
+{
+    QList<QFuture<AudioBuffer*> > futures;
+
+    for (int i = 0; i < fileNames.count(); i++)
+        futures.append(load(fileNames[i], flags));
+
+    return futures;
+}
+
+
+/*!
+  Returns true if any of the files is still being loaded, false otherwise.
+*/
+bool AudioBufferLoader::isLoading() const
+{
+    return !m_pending.isEmpty();
+}
+
+
+/*!
+  Blocks until all the pending files have been loaded and emits the
+  signals for them.
+*/
+void AudioBufferLoader::waitForFinished()
+{
+    while (!m_pending.isEmpty()) {
+        QObject *watcher = m_pending.constBegin().key();
+        static_cast<QFutureWatcher<AudioBuffer*>*>(watcher)->waitForFinished();
+        finishLoad(watcher);
+    }
+}
+
+
+/*!
+  Called when a file has been loaded.
+*/
+void AudioBufferLoader::loadFinished()
+{
+    if (m_pending.contains(sender()))
+        finishLoad(sender());
+}
+
+
+/*!
+  Releases \a watcher of a completed load and emits the signals.
+*/
+void AudioBufferLoader::finishLoad(QObject *watcher)
+{
+    const QString fileName(m_pending.take(watcher));
+    AudioBuffer *buffer =
+        static_cast<QFutureWatcher<AudioBuffer*>*>(watcher)->result();
+
+    watcher->disconnect(this);
+    watcher->deleteLater();
+    m_loadedCount++;
+
+    emit loaded(fileName, buffer);
+    emit progress(m_loadedCount, m_totalCount);
+
+    if (m_pending.isEmpty()) {
+        // The batch is complete, start counting from zero again.
+        m_loadedCount = 0;
+        m_totalCount = 0;
+        emit finished();
+    }
+}
+
+
+/*!
+  Run in a worker thread. Loads \a fileName with \a flags, from \a archive
+  if it contains the name, and moves the buffer to \a targetThread. Returns
+  the buffer or NULL if the loading failed.
+*/
+AudioBuffer *AudioBufferLoader::loadInThread(QString fileName,
+                                             AudioBuffer::LoadFlags flags,
+                                             const AssetArchive *archive,
+                                             QThread *targetThread)
+{
+    AudioBuffer *buffer(0);
+
+    if (archive && archive->contains(fileName))
+        buffer = AudioBuffer::loadWavData(archive->data(fileName), 0, flags);
+    else
+        buffer = AudioBuffer::loadWav(fileName, 0, flags);
+
+    if (!buffer) {
+        DEBUG_INFO("Failed to load" << fileName);
+        return 0;
+    }
+
+    buffer->moveToThread(targetThread);
+    return buffer;
+}
@@ -0,0 +1,76 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#ifndef GEAUDIOBUFFERLOADER_H
+#define GEAUDIOBUFFERLOADER_H
+
+#include <QFuture>
+#include <QHash>
+#include <QList>
+#include <QObject>
+#include <QString>
+#include <QStringList>
+#include "audiobuffer.h"
+
+// Forward declarations
+class QThread;
+
+
+namespace GE {
+
+// Forward declarations
+class AssetArchive;
+
+class AudioBufferLoader : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit AudioBufferLoader(QObject *parent = 0);
+    virtual ~AudioBufferLoader();
+
+public:
+    QFuture<AudioBuffer*> load(const QString &fileName,
+                               AudioBuffer::LoadFlags flags =
+                                   AudioBuffer::NoLoadFlags);
+    QList<QFuture<AudioBuffer*> > load(const QStringList &fileNames,
+                                       AudioBuffer::LoadFlags flags =
+                                           AudioBuffer::NoLoadFlags);
+
+    inline void setArchive(const AssetArchive *archive) { m_archive = archive; }
+    inline const AssetArchive *archive() const { return m_archive; }
+
+    inline int pendingCount() const { return m_pending.count(); }
+    inline int loadedCount() const { return m_loadedCount; }
+    inline int totalCount() const { return m_totalCount; }
+    bool isLoading() const;
+    void waitForFinished();
+
+signals:
+    void loaded(const QString &fileName, GE::AudioBuffer *buffer);
+    void progress(int loadedCount, int totalCount);
+    void finished();
+
+protected slots:
+    void loadFinished();
+
+protected:
+    void finishLoad(QObject *watcher);
+    static AudioBuffer *loadInThread(QString fileName,
+                                     AudioBuffer::LoadFlags flags,
+                                     const AssetArchive *archive,
+                                     QThread *targetThread);
+
+protected: // Data
+    QHash<QObject*, QString> m_pending; // Watchers, owned
+    const AssetArchive *m_archive; // Not owned, may be NULL
+    int m_loadedCount;
+    int m_totalCount;
+};
+
+} // namespace GE
+
+#endif // GEAUDIOBUFFERLOADER_H
@@ -5,13 +5,11 @@
  */
 
 #include "audiobufferplayinstance.h"
-#include "audiobuffer.h"
 #include "trace.h"
 
 using namespace GE;
 
 // Constants
-const float GEMaxAudioSpeedValue(4096.0f);
 const float GEDefaultAudioVolume(1.0f); // 1.0 => 100 %
 const float GEDefaultAudioSpeed(1.0f); // 1.0 => 100 %
 
@@ -28,15 +26,7 @@ const float GEDefaultAudioSpeed(1.0f); // 1.0 => 100 %
 AudioBufferPlayInstance::AudioBufferPlayInstance(AudioBuffer *buffer /* = 0 */,
                                                  QObject *parent /* = 0 */)
     : AudioSource(parent),
-      m_buffer(0),
-      m_finished(false),
-      m_destroyWhenFinished(true),
-      m_fixedPos(0),
-      m_fixedInc(0),
-      m_fixedLeftVolume((int)GEMaxAudioVolumeValue),
-      m_fixedRightVolume((int)GEMaxAudioVolumeValue),
-      m_fixedCenter(0),
-      m_loopCount(0)
+      m_destroyWhenFinished(true)
 {
     if (buffer) {
         // Start playing the given buffer.
@@ -58,10 +48,7 @@ AudioBufferPlayInstance::~AudioBufferPlayInstance()
 */
 bool AudioBufferPlayInstance::isPlaying() const
 {
-    if (m_buffer)
-        return true;
-
-    return false;
+    return m_voice.isPlaying();
 }
 
 
@@ -73,7 +60,7 @@ bool AudioBufferPlayInstance::isPlaying() const
 */
 bool AudioBufferPlayInstance::canBeDestroyed()
 {
-    if (m_finished && m_destroyWhenFinished)
+    if (m_voice.isFinished() && m_destroyWhenFinished)
         return true;
 
     return false;
@@ -83,85 +70,55 @@ bool AudioBufferPlayInstance::canBeDestroyed()
 /*!
   From AudioSource.
 
-  Returns an audio stream from the current sample.
+  Returns an audio stream from the current sample. Emits finished() if the
+  sample ends.
 */
 int AudioBufferPlayInstance::pullAudio(AUDIO_SAMPLE_TYPE *target,
                                        int bufferLength)
 {
-    if (!m_buffer) {
+    if (!m_voice.isPlaying()) {
         // No sample!
         return 0;
     }
 
-    int divider(m_buffer->getNofChannels() * m_buffer->getBytesPerSample());
-    int channelLength(0);
-
-    // Check in case of division by zero.
-    if (divider) {
-        channelLength = m_buffer->getDataLength() / divider - 2;
-    }
-    else {
-        DEBUG_INFO("Warning: Catched division by zero error!");
-    }
-
-    int samplesToWrite(bufferLength / 2);
-    int amount(0);
-    int totalMixed(0);
-
-
-    while (samplesToWrite > 0) {
-        int samplesLeft = channelLength - (m_fixedPos >> 12);
+    const int mixed(m_voice.pullAudio(target, bufferLength));
 
-        if (m_fixedInc == 0) {
-            // No speed set. Will lead to division by zero error if not set.
-            setSpeed(GEDefaultAudioSpeed);
-        }
+    if (m_voice.isFinished())
+        emit finished();
 
-        // This is how much we can mix at least.
-        int maxMixAmount = (int)(((long long int)(samplesLeft) << 12) /
-                                 m_fixedInc);
-
-        if (maxMixAmount > samplesToWrite) {
-            maxMixAmount = samplesToWrite;
-        }
+    return mixed;
+}
 
-        if (maxMixAmount > 0) {
-            amount = mixBlock(target+totalMixed * 2, maxMixAmount);
 
-            if (amount == 0) {
-                // Error!
-                break;
-            }
+/*!
+  From AudioSource.
 
-            totalMixed += amount;
-        }
-        else {
-            amount = 0;
-            m_fixedPos = channelLength<<12;
-        }
+  Returns the louder of the channel volumes or 0 if nothing is playing.
+*/
+int AudioBufferPlayInstance::audibleVolume() const
+{
+    return m_voice.audibleVolume();
+}
 
-        // The sample ended. Check the looping variables and see what to do.
-        if ((m_fixedPos >> 12) >= channelLength) {
-            m_fixedPos -= (channelLength << 12);
 
-            if (m_loopCount > 0)
-                m_loopCount--;
+/*!
+  From AudioSource.
 
-            if (m_loopCount == 0) {
-                // No more loops, stop the sample and return the amount of
-                // samples already mixed.
-                stop();
-                return totalMixed;
-            }
-        }
+  Advances the play position without mixing. Emits finished() if the sample
+  ends.
+*/
+void AudioBufferPlayInstance::skipAudio(AUDIO_SAMPLE_TYPE *scratch,
+                                        int bufferLength)
+{
+    Q_UNUSED(scratch);
 
-        samplesToWrite -= amount;
+    if (!m_voice.isPlaying())
+        return;
 
-        if (samplesToWrite < 1)
-            break;
-    }
+    m_voice.skipAudio(bufferLength);
 
-    return totalMixed * 2;
+    if (m_voice.isFinished())
+        emit finished();
 }
 
 
@@ -173,9 +130,7 @@ int AudioBufferPlayInstance::pullAudio(AUDIO_SAMPLE_TYPE *target,
 void AudioBufferPlayInstance::playBuffer(AudioBuffer *buffer,
                                          int loopCount /* = 0 */)
 {
-    m_buffer = buffer;
-    m_loopCount = loopCount;
-    m_fixedPos = 0;
+    m_voice.play(buffer, loopCount);
 }
 
 
@@ -190,10 +145,7 @@ void AudioBufferPlayInstance::playBuffer(AudioBuffer *buffer,
                                          float speed,
                                          int loopCount /* = 0 */)
 {
-    setLeftVolume(volume);
-    m_fixedRightVolume = m_fixedLeftVolume;
-    setSpeed(speed);
-    playBuffer(buffer, loopCount);
+    m_voice.play(buffer, volume, speed, loopCount);
 }
 
 
@@ -202,8 +154,7 @@ void AudioBufferPlayInstance::playBuffer(AudioBuffer *buffer,
 */
 void AudioBufferPlayInstance::stop()
 {
-    m_buffer = 0;
-    m_finished = true;
+    m_voice.stop();
     emit finished();
 }
 
@@ -214,8 +165,7 @@ void AudioBufferPlayInstance::stop()
 */
 void AudioBufferPlayInstance::setLoopCount(int count)
 {
-    DEBUG_INFO("Setting the loop count to " << count);
-    m_loopCount = count;
+    m_voice.setLoopCount(count);
 }
 
 
@@ -225,13 +175,7 @@ void AudioBufferPlayInstance::setLoopCount(int count)
 */
 void AudioBufferPlayInstance::setSpeed(float speed)
 {
-    if (!m_buffer)
-        return;
-
-    m_fixedInc =
-        (int)(((float)m_buffer->getSamplesPerSec() *
-               GEMaxAudioSpeedValue * speed) /
-              (float)AUDIO_FREQUENCY);
+    m_voice.setSpeed(speed);
 }
 
 
@@ -241,7 +185,7 @@ void AudioBufferPlayInstance::setSpeed(float speed)
 */
 void AudioBufferPlayInstance::setLeftVolume(float volume)
 {
-    m_fixedLeftVolume = (int)(GEMaxAudioVolumeValue * volume);
+    m_voice.setLeftVolume(volume);
 }
 
 
@@ -251,70 +195,16 @@ void AudioBufferPlayInstance::setLeftVolume(float volume)
 */
 void AudioBufferPlayInstance::setRightVolume(float volume)
 {
-    m_fixedRightVolume = (int)(GEMaxAudioVolumeValue * volume);
+    m_voice.setRightVolume(volume);
 }
 
 
 /*!
-  TODO: Document this method.
-
-  Note: Does not do any bound checking, must be checked before called!
+  Sets the interpolation used when resampling the buffer to \a mode. See
+  AudioVoice::setInterpolationMode().
 */
-int AudioBufferPlayInstance::mixBlock(AUDIO_SAMPLE_TYPE *target,
-                                      int samplesToMix)
+void AudioBufferPlayInstance::setInterpolationMode(
+        AudioVoice::InterpolationMode mode)
 {
-    SAMPLE_FUNCTION_TYPE sampleFunction = m_buffer->getSampleFunction();
-
-    if (!sampleFunction) {
-        // Unsupported sample type.
-        return 0;
-    }
-
-    AUDIO_SAMPLE_TYPE *t_target = target + samplesToMix * 2;
-    int sourcepos(0);
-
-    if (m_buffer->getNofChannels() == 2) {
-        // Stereo
-        while (target != t_target) {
-            sourcepos = m_fixedPos >> 12;
-
-            target[0] = (((((sampleFunction)
-                            (m_buffer, sourcepos, 0) *
-                            (4096 - (m_fixedPos & 4095)) +
-                            (sampleFunction)(m_buffer, sourcepos + 1, 0) *
-                            (m_fixedPos & 4095)) >> 12) *
-                          m_fixedLeftVolume) >> 12);
-
-            target[1] = (((((sampleFunction)
-                            (m_buffer, sourcepos, 1) *
-                            (4096 - (m_fixedPos & 4095)) +
-                            (sampleFunction)(m_buffer, sourcepos + 1, 1) *
-                            (m_fixedPos & 4095) ) >> 12) *
-                          m_fixedRightVolume) >> 12);
-
-            m_fixedPos += m_fixedInc;
-            target += 2;
-        }
-    }
-    else {
-        // Mono
-        int temp(0);
-
-        while (target != t_target) {
-            sourcepos = m_fixedPos >> 12;
-
-            temp = (((sampleFunction)(m_buffer, sourcepos, 0 ) *
-                     (4096 - (m_fixedPos & 4095)) +
-                     (sampleFunction)(m_buffer, sourcepos + 1, 0) *
-                     (m_fixedPos & 4095)) >> 12);
-
-            target[0] = ((temp * m_fixedLeftVolume) >> 12);
-            target[1] = ((temp * m_fixedRightVolume) >> 12);
-
-            m_fixedPos += m_fixedInc;
-            target += 2;
-        }
-    }
-
-    return samplesToMix;
+    m_voice.setInterpolationMode(mode);
 }
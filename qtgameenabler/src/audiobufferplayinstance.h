@@ -8,6 +8,7 @@
 #define GEAUDIOBUFFERPLAYINSTANCE_H
 
 #include "audiosourceif.h"
+#include "audiovoice.h"
 
 
 namespace GE {
@@ -26,13 +27,15 @@ public:
 
 public:
     bool isPlaying() const;
-    inline bool isFinished() const { return m_finished; }
+    inline bool isFinished() const { return m_voice.isFinished(); }
     inline void setDestroyWhenFinished(bool set) { m_destroyWhenFinished = set; }
     inline bool destroyWhenFinished() const { return m_destroyWhenFinished; }
 
 public: // From AudioSource
     bool canBeDestroyed();
+    int audibleVolume() const;
     int pullAudio(AUDIO_SAMPLE_TYPE *target, int bufferLength);
+    void skipAudio(AUDIO_SAMPLE_TYPE *scratch, int bufferLength);
 
 public slots:
     void playBuffer(AudioBuffer *buffer, int loopCount = 0);
@@ -45,23 +48,14 @@ public slots:
     void setSpeed(float speed);
     void setLeftVolume(float volume);
     void setRightVolume(float volume);
-
-protected:
-    int mixBlock(AUDIO_SAMPLE_TYPE *target, int bufferLength);
+    void setInterpolationMode(AudioVoice::InterpolationMode mode);
 
 signals:
     void finished();
 
 protected: // Data
-    AudioBuffer *m_buffer; // Not owned
-    bool m_finished;
+    AudioVoice m_voice;
     bool m_destroyWhenFinished;
-    int m_fixedPos;
-    int m_fixedInc;
-    int m_fixedLeftVolume;
-    int m_fixedRightVolume;
-    int m_fixedCenter;
-    int m_loopCount;
 };
 
 } // namespace GE
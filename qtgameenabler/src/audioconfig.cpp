@@ -0,0 +1,121 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#include "audioconfig.h"
+#include <QAtomicInt>
+#include <QtMultimedia/qaudiodeviceinfo.h>
+#include "trace.h" // For debug macros
+
+using namespace GE;
+
+// Constants
+const int GEMixChannelCount(2);
+const QString GEMixAudioCodec("audio/pcm");
+
+// The active mixing sample rate, 0 until resolved.
+static QAtomicInt mixSampleRate(0);
+
+
+/*!
+  \class AudioConfig
+  \brief The output format shared by the mixer, the voices and AudioOut.
+
+  The sample type (AUDIO_SAMPLE_TYPE) and the channel count are fixed at
+  compile time but the sample rate is chosen at runtime. By default it is
+  the preferred rate of the default audio output device, so that the device
+  does not need to resample the mixed audio. AUDIO_FREQUENCY is used if the
+  device does not report a usable rate.
+*/
+
+
+/*!
+  Returns the active mixing sample rate. Resolved from the default output
+  device on the first call unless set with setSampleRate().
+*/
+int AudioConfig::sampleRate()
+{
+    const int rate(mixSampleRate);
+
+    if (rate > 0)
+        return rate;
+
+    mixSampleRate.testAndSetOrdered(0, preferredSampleRate(
+        QAudioDeviceInfo::defaultOutputDevice()));
+
+    return mixSampleRate;
+}
+
+
+/*!
+  Sets \a rate as the mixing sample rate. Should be called before creating
+  AudioOut, for example to mix at a lower rate to save CPU. If changed while
+  playing, the voices adapt their speed on the next mixed block. AudioOut
+  calls this if the device does not support the rate.
+*/
+void AudioConfig::setSampleRate(int rate)
+{
+    if (rate <= 0)
+        return;
+
+    DEBUG_INFO("Mixing sample rate set to " << rate);
+    mixSampleRate = rate;
+}
+
+
+/*!
+  Returns the number of interleaved channels in the mixed audio.
+*/
+int AudioConfig::channelCount()
+{
+    return GEMixChannelCount;
+}
+
+
+/*!
+  Returns the size of a mixed sample in bits.
+*/
+int AudioConfig::sampleSize()
+{
+    return AUDIO_SAMPLE_BITS;
+}
+
+
+/*!
+  Returns the format of the mixed audio.
+*/
+QAudioFormat AudioConfig::format()
+{
+    QAudioFormat format;
+    format.setFrequency(sampleRate());
+    format.setChannels(GEMixChannelCount);
+    format.setSampleSize(AUDIO_SAMPLE_BITS);
+    format.setCodec(GEMixAudioCodec);
+    format.setByteOrder(QAudioFormat::LittleEndian);
+    format.setSampleType(QAudioFormat::SignedInt);
+    return format;
+}
+
+
+/*!
+  Returns the native sample rate of \a device or AUDIO_FREQUENCY if the
+  device does not report one it supports.
+*/
+int AudioConfig::preferredSampleRate(const QAudioDeviceInfo &device)
+{
+    if (device.isNull())
+        return AUDIO_FREQUENCY;
+
+    const int rate(device.preferredFormat().frequency());
+    const QList<int> rates(device.supportedFrequencies());
+
+    if (rate <= 0 || (!rates.isEmpty() && !rates.contains(rate))) {
+        DEBUG_INFO("No preferred rate, using " << AUDIO_FREQUENCY);
+        return AUDIO_FREQUENCY;
+    }
+
+    DEBUG_INFO("Preferred rate of the device: " << rate);
+    return rate;
+}
@@ -0,0 +1,32 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#ifndef GEAUDIOCONFIG_H
+#define GEAUDIOCONFIG_H
+
+#include <QAudioFormat>
+#include "audiosourceif.h"
+
+// Forward declarations
+class QAudioDeviceInfo;
+
+
+namespace GE {
+
+class AudioConfig
+{
+public:
+    static int sampleRate();
+    static void setSampleRate(int rate);
+    static int channelCount();
+    static int sampleSize();
+    static QAudioFormat format();
+    static int preferredSampleRate(const QAudioDeviceInfo &device);
+};
+
+} // namespace GE
+
+#endif // GEAUDIOCONFIG_H
@@ -0,0 +1,168 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#include "audioconvert.h"
+
+using namespace GE;
+
+
+/*!
+  Converts a single sample to AUDIO_SAMPLE_TYPE. The conversions match the
+  AudioBuffer::sampleFunction* implementations except that the floating
+  point samples are clamped.
+*/
+namespace {
+
+inline AUDIO_SAMPLE_TYPE convert8bit(const void *data, int index)
+{
+    return (AUDIO_SAMPLE_TYPE)((((const quint8*)data)[index] - 128) << 8);
+}
+
+inline AUDIO_SAMPLE_TYPE convert16bit(const void *data, int index)
+{
+    return (AUDIO_SAMPLE_TYPE)(((const quint16*)data)[index]);
+}
+
+inline AUDIO_SAMPLE_TYPE convert32bit(const void *data, int index)
+{
+    const float sample(((const float*)data)[index] * 32768.0f);
+
+    if (sample >= 32767.0f)
+        return 32767;
+
+    if (sample <= -32768.0f)
+        return -32768;
+
+    return (AUDIO_SAMPLE_TYPE)sample;
+}
+
+} // namespace
+
+
+/*!
+  \class AudioConverter
+  \brief Converts PCM audio into the interleaved stereo AUDIO_SAMPLE_TYPE
+         format used by the mixer.
+
+  Used when loading audio so that the conversion is paid once instead of on
+  every mixed sample.
+*/
+
+
+/*!
+  Returns true if the data with \a bitsPerSample and \a channels can be
+  converted, false otherwise.
+*/
+bool AudioConverter::isSupported(int bitsPerSample, int channels)
+{
+    if (channels != 1 && channels != 2)
+        return false;
+
+    return (bitsPerSample == 8 || bitsPerSample == 16 || bitsPerSample == 32);
+}
+
+
+/*!
+  Converts \a frames frames of \a source with \a bitsPerSample and
+  \a channels into interleaved stereo in \a target, which must hold
+  2 * \a frames samples. Mono data is copied to both channels.
+*/
+void AudioConverter::toStereo(const void *source,
+                              int frames,
+                              int bitsPerSample,
+                              int channels,
+                              AUDIO_SAMPLE_TYPE *target)
+{
+    AUDIO_SAMPLE_TYPE (*convert)(const void*, int) = convert16bit;
+
+    if (bitsPerSample == 8)
+        convert = convert8bit;
+    else if (bitsPerSample == 32)
+        convert = convert32bit;
+
+    if (channels == 2) {
+        for (int i = 0; i < frames * 2; i++)
+            target[i] = convert(source, i);
+    }
+    else {
+        for (int i = 0; i < frames; i++) {
+            target[i * 2] = convert(source, i);
+            target[i * 2 + 1] = target[i * 2];
+        }
+    }
+}
+
+
+/*!
+  Narrows \a samples samples of 24 or 32-bit (\a bitsPerSample) integer PCM
+  in \a source to 16 bits in \a target by dropping the low bytes. The
+  target may be the same as the source.
+*/
+void AudioConverter::toPcm16(const void *source,
+                             int samples,
+                             int bitsPerSample,
+                             AUDIO_SAMPLE_TYPE *target)
+{
+    const int step(bitsPerSample / 8);
+
+    // The samples are little-endian, the two highest bytes are the last.
+    const quint8 *bytes = (const quint8*)source + step - 2;
+
+    for (int i = 0; i < samples; i++) {
+        target[i] = (AUDIO_SAMPLE_TYPE)(bytes[0] | (bytes[1] << 8));
+        bytes += step;
+    }
+}
+
+
+/*!
+  Returns the number of frames \a frames frames at \a fromRate will have
+  after resampling to \a toRate.
+*/
+int AudioConverter::resampledLength(int frames, int fromRate, int toRate)
+{
+    if (fromRate <= 0 || toRate <= 0)
+        return 0;
+
+    return (int)((qint64)frames * toRate / fromRate);
+}
+
+
+/*!
+  Resamples \a frames interleaved stereo frames of \a source from
+  \a fromRate to \a toRate into \a target using linear interpolation. The
+  target must hold 2 * resampledLength() samples.
+*/
+void AudioConverter::resample(const AUDIO_SAMPLE_TYPE *source,
+                              int frames,
+                              int fromRate,
+                              int toRate,
+                              AUDIO_SAMPLE_TYPE *target)
+{
+    const int targetFrames(resampledLength(frames, fromRate, toRate));
+
+    if (frames <= 0 || targetFrames <= 0)
+        return;
+
+    // 16.16 fixed point step through the source.
+    const qint64 fixedInc(((qint64)fromRate << 16) / toRate);
+    qint64 fixedPos(0);
+
+    for (int i = 0; i < targetFrames; i++) {
+        const int pos((int)(fixedPos >> 16));
+        const int frac((int)(fixedPos & 0xffff));
+        const int next(pos + 1 < frames ? pos + 1 : frames - 1);
+
+        for (int channel = 0; channel < 2; channel++) {
+            const qint64 s0(source[pos * 2 + channel]);
+            const qint64 s1(source[next * 2 + channel]);
+            target[i * 2 + channel] =
+                (AUDIO_SAMPLE_TYPE)(s0 + (((s1 - s0) * frac) >> 16));
+        }
+
+        fixedPos += fixedInc;
+    }
+}
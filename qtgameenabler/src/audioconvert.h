@@ -0,0 +1,39 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#ifndef GEAUDIOCONVERT_H
+#define GEAUDIOCONVERT_H
+
+#include "audiosourceif.h"
+
+
+namespace GE {
+
+class AudioConverter
+{
+public:
+    static bool isSupported(int bitsPerSample, int channels);
+    static void toStereo(const void *source,
+                         int frames,
+                         int bitsPerSample,
+                         int channels,
+                         AUDIO_SAMPLE_TYPE *target);
+    static void toPcm16(const void *source,
+                        int samples,
+                        int bitsPerSample,
+                        AUDIO_SAMPLE_TYPE *target);
+
+    static int resampledLength(int frames, int fromRate, int toRate);
+    static void resample(const AUDIO_SAMPLE_TYPE *source,
+                         int frames,
+                         int fromRate,
+                         int toRate,
+                         AUDIO_SAMPLE_TYPE *target);
+};
+
+} // namespace GE
+
+#endif // GEAUDIOCONVERT_H
@@ -0,0 +1,233 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#include "audiointerpolation.h"
+#include <QElapsedTimer>
+#include <math.h>
+#include "audioconfig.h"
+#include "audiokernels.h"
+#include "trace.h" // For debug macros
+
+using namespace GE;
+
+// Constants
+const double GEPi(3.14159265358979323846);
+const int GEBenchmarkBlockLength(1024); // In stereo samples
+
+// The cutoff of each sinc band relative to the Nyquist frequency of the
+// source, and the highest speed (source frames per output frame) for which
+// the band is used. The last band is used for all the higher speeds.
+const double GESincBandCutoffs[GESincBandCount] = { 0.9, 0.6, 0.45, 0.3 };
+const double GESincBandSpeeds[GESincBandCount] = { 1.0, 1.5, 2.0, 3.0 };
+
+
+namespace {
+
+/*!
+  Scales \a coefficients of one phase to Q14 so that they sum up exactly to
+  1.0, i.e. a constant signal passes unchanged.
+*/
+void quantizePhase(const double *coefficients, int taps, qint16 *target)
+{
+    const int one(1 << GEInterpolationCoefficientBits);
+    double sum(0.0);
+
+    for (int i = 0; i < taps; i++)
+        sum += coefficients[i];
+
+    int total(0);
+    int largest(0);
+
+    for (int i = 0; i < taps; i++) {
+        target[i] = (qint16)floor(coefficients[i] / sum * one + 0.5);
+        total += target[i];
+
+        if (target[i] > target[largest])
+            largest = i;
+    }
+
+    // Put the rounding error to the largest coefficient.
+    target[largest] = (qint16)(target[largest] + one - total);
+}
+
+
+/*!
+  \class InterpolationTables
+  \brief The coefficient tables of the interpolation filters.
+
+  The tables are computed once when the library is loaded. Each table holds
+  GEInterpolationPhases rows of taps, the row being selected by the top
+  bits of the fractional play position. The rows are contiguous and the
+  tables aligned for SIMD loads.
+
+  The taps of a row apply to the source frames starting from
+  (position - taps / 2 + 1).
+*/
+class InterpolationTables
+{
+public:
+    InterpolationTables()
+        : m_cubic(0)
+    {
+        m_cubic = (qint16*)AudioKernels::allocateBuffer(
+            sizeof(qint16) * GEInterpolationPhases * GECubicTaps);
+
+        for (int band = 0; band < GESincBandCount; band++) {
+            m_sinc[band] = (qint16*)AudioKernels::allocateBuffer(
+                sizeof(qint16) * GEInterpolationPhases * GESincTaps);
+        }
+
+        double coefficients[GESincTaps];
+
+        for (int phase = 0; phase < GEInterpolationPhases; phase++) {
+            const double t((double)phase / GEInterpolationPhases);
+
+            // Catmull-Rom spline
+            coefficients[0] = 0.5 * (-t * t * t + 2.0 * t * t - t);
+            coefficients[1] = 0.5 * (3.0 * t * t * t - 5.0 * t * t + 2.0);
+            coefficients[2] = 0.5 * (-3.0 * t * t * t + 4.0 * t * t + t);
+            coefficients[3] = 0.5 * (t * t * t - t * t);
+            quantizePhase(coefficients, GECubicTaps,
+                          m_cubic + phase * GECubicTaps);
+
+            // Blackman windowed sinc
+            for (int band = 0; band < GESincBandCount; band++) {
+                const double cutoff(GESincBandCutoffs[band]);
+                const double halfWidth(GESincTaps / 2);
+
+                for (int i = 0; i < GESincTaps; i++) {
+                    const double x(i - (GESincTaps / 2 - 1) - t);
+                    const double y(GEPi * cutoff * x);
+                    const double sinc(x == 0.0 ? 1.0 : sin(y) / y);
+                    const double window(
+                        0.42 + 0.5 * cos(GEPi * x / halfWidth) +
+                        0.08 * cos(2.0 * GEPi * x / halfWidth));
+
+                    coefficients[i] = sinc * window;
+                }
+
+                quantizePhase(coefficients, GESincTaps,
+                              m_sinc[band] + phase * GESincTaps);
+            }
+        }
+    }
+
+    ~InterpolationTables()
+    {
+        AudioKernels::freeBuffer(m_cubic);
+
+        for (int band = 0; band < GESincBandCount; band++)
+            AudioKernels::freeBuffer(m_sinc[band]);
+    }
+
+public: // Data
+    qint16 *m_cubic; // Owned
+    qint16 *m_sinc[GESincBandCount]; // Owned
+};
+
+InterpolationTables interpolationTables;
+
+} // namespace
+
+
+/*!
+  \class AudioInterpolation
+  \brief The filter tables of the interpolating mixing kernels and a
+         benchmark for choosing the interpolation mode of a voice.
+
+  See AudioVoice::setInterpolationMode().
+*/
+
+
+/*!
+  Returns the coefficient table of the four-tap cubic interpolation.
+*/
+const qint16 *AudioInterpolation::cubicTable()
+{
+    return interpolationTables.m_cubic;
+}
+
+
+/*!
+  Returns the coefficient table of the eight-tap windowed sinc
+  interpolation for the play increment \a fixedInc (32.32 fixed point).
+  When the sound is played faster than the mixing rate, a table with a
+  lower cutoff is returned so that the frequencies above the new Nyquist
+  frequency are filtered out instead of aliasing.
+*/
+const qint16 *AudioInterpolation::sincTable(qint64 fixedInc)
+{
+    const double speed((double)fixedInc / (double)(Q_INT64_C(1) << 32));
+    int band(0);
+
+    while (band < GESincBandCount - 1 && speed > GESincBandSpeeds[band])
+        band++;
+
+    return interpolationTables.m_sinc[band];
+}
+
+
+/*!
+  Mixes \a milliseconds of \a buffer looped at \a speed with a single voice
+  using the interpolation \a mode. Returns the time taken relative to the
+  length of the mixed audio, e.g. 0.01 means that a voice costs 1 % of the
+  time of one CPU core.
+*/
+float AudioInterpolation::measureCost(AudioBuffer *buffer,
+                                      AudioVoice::InterpolationMode mode,
+                                      float speed,
+                                      int milliseconds /* = 10000 */)
+{
+    if (!buffer || milliseconds < 1)
+        return 0.0f;
+
+    AudioVoice voice;
+    voice.play(buffer, 1.0f, speed, -1);
+    voice.setInterpolationMode(mode);
+
+    AUDIO_SAMPLE_TYPE *block = (AUDIO_SAMPLE_TYPE*)AudioKernels::allocateBuffer(
+        sizeof(AUDIO_SAMPLE_TYPE) * GEBenchmarkBlockLength * 2);
+    const qint64 frames((qint64)AudioConfig::sampleRate() * milliseconds /
+                        1000);
+
+    QElapsedTimer timer;
+    timer.start();
+
+    for (qint64 mixed = 0; mixed < frames && voice.isPlaying();
+         mixed += GEBenchmarkBlockLength) {
+        voice.pullAudio(block, GEBenchmarkBlockLength * 2);
+    }
+
+    const qint64 elapsed(timer.elapsed());
+    AudioKernels::freeBuffer(block);
+
+    return (float)elapsed / (float)milliseconds;
+}
+
+
+/*!
+  For convenience.
+
+  Measures the cost of each interpolation mode with \a buffer played at
+  \a speed, see measureCost(). Returns the costs indexed by
+  AudioVoice::InterpolationMode.
+*/
+QVector<float> AudioInterpolation::measureCosts(
+        AudioBuffer *buffer,
+        float speed /* = 1.5f */,
+        int milliseconds /* = 10000 */)
+{
+    QVector<float> costs(AudioVoice::InterpolationModeCount, 0.0f);
+
+    for (int mode = 0; mode < AudioVoice::InterpolationModeCount; mode++) {
+        costs[mode] = measureCost(buffer, (AudioVoice::InterpolationMode)mode,
+                                  speed, milliseconds);
+        DEBUG_INFO("Mode" << mode << "costs" << costs[mode] * 100.0f <<
+                   "% of a CPU core per voice at the speed" << speed);
+    }
+
+    return costs;
+}
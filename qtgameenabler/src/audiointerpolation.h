@@ -0,0 +1,42 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#ifndef GEAUDIOINTERPOLATION_H
+#define GEAUDIOINTERPOLATION_H
+
+#include <QVector>
+#include "audiovoice.h"
+
+
+namespace GE {
+
+// Constants
+const int GEInterpolationPhaseBits(8);
+const int GEInterpolationPhases(1 << GEInterpolationPhaseBits);
+const int GEInterpolationCoefficientBits(14); // The coefficients are Q14
+const int GECubicTaps(4);
+const int GESincTaps(8);
+const int GESincBandCount(4);
+
+
+class AudioInterpolation
+{
+public:
+    static const qint16 *cubicTable();
+    static const qint16 *sincTable(qint64 fixedInc);
+
+    static float measureCost(AudioBuffer *buffer,
+                             AudioVoice::InterpolationMode mode,
+                             float speed,
+                             int milliseconds = 10000);
+    static QVector<float> measureCosts(AudioBuffer *buffer,
+                                       float speed = 1.5f,
+                                       int milliseconds = 10000);
+};
+
+} // namespace GE
+
+#endif // GEAUDIOINTERPOLATION_H
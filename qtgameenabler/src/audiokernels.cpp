@@ -0,0 +1,474 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#include "audiokernels.h"
+
+#include <QtGlobal>
+
+#ifdef GE_AUDIO_SSE2
+    #include <emmintrin.h>
+    #if defined(_MSC_VER)
+        #include <intrin.h>
+    #elif defined(__i386__)
+        #include <cpuid.h>
+    #endif
+#endif
+
+#ifdef GE_AUDIO_NEON
+    #include <arm_neon.h>
+    #ifdef Q_OS_LINUX
+        #include <stdio.h>
+    #endif
+#endif
+
+#include "trace.h" // For debug macros
+
+using namespace GE;
+
+// Constants
+const int GEMaxSimdVolume(32767); // The volume must fit into 16 bits
+#if defined(GE_AUDIO_NEON) && defined(Q_OS_LINUX)
+const unsigned long GEAuxvHwCap(16); // AT_HWCAP
+const unsigned long GEHwCapNeon(1 << 12); // HWCAP_NEON
+#endif
+
+
+/*!
+  \class AudioKernels
+  \brief Low level sample processing routines used by the mixer with
+         implementations for SSE2 and NEON capable CPUs.
+*/
+
+
+/*!
+  Returns the SIMD features of the CPU as a combination of CpuFeature
+  flags. Only the features the library was compiled with are reported. The
+  features are resolved on the first call only.
+*/
+int AudioKernels::cpuFeatures()
+{
+    static int detectedFeatures(-1);
+
+    if (detectedFeatures >= 0)
+        return detectedFeatures;
+
+    int features(NoFeatures);
+
+#ifdef GE_AUDIO_SSE2
+#if defined(__x86_64__) || defined(_M_X64)
+    // SSE2 is a part of the x86-64 base instruction set.
+    features |= Sse2;
+#elif defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 1);
+
+    if (info[3] & (1 << 26))
+        features |= Sse2;
+#else
+    unsigned int eax(0), ebx(0), ecx(0), edx(0);
+
+    if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (edx & (1 << 26)))
+        features |= Sse2;
+#endif
+#endif // GE_AUDIO_SSE2
+
+#ifdef GE_AUDIO_NEON
+#ifdef Q_OS_LINUX
+    // Not all ARMv7 cores have NEON, check the hardware capabilities given
+    // to the process by the kernel.
+    FILE *auxv = fopen("/proc/self/auxv", "rb");
+
+    if (auxv) {
+        unsigned long entry[2];
+
+        while (fread(entry, sizeof(entry), 1, auxv) == 1 && entry[0]) {
+            if (entry[0] == GEAuxvHwCap) {
+                if (entry[1] & GEHwCapNeon)
+                    features |= Neon;
+
+                break;
+            }
+        }
+
+        fclose(auxv);
+    }
+#else
+    features |= Neon;
+#endif
+#endif // GE_AUDIO_NEON
+
+    DEBUG_INFO("CPU features:" << features);
+    detectedFeatures = features;
+    return features;
+}
+
+
+/*!
+  Returns the fastest accumulate function supported by the CPU.
+*/
+ACCUMULATE_FUNCTION_TYPE AudioKernels::accumulateFunction()
+{
+    const int features(cpuFeatures());
+    Q_UNUSED(features);
+
+#ifdef GE_AUDIO_SSE2
+    if (features & Sse2)
+        return accumulateSse2;
+#endif
+
+#ifdef GE_AUDIO_NEON
+    if (features & Neon)
+        return accumulateNeon;
+#endif
+
+    return accumulateScalar;
+}
+
+
+/*!
+  Returns the fastest 32-bit bus accumulate function supported by the CPU.
+*/
+ACCUMULATE32_FUNCTION_TYPE AudioKernels::accumulate32Function()
+{
+    const int features(cpuFeatures());
+    Q_UNUSED(features);
+
+#ifdef GE_AUDIO_SSE2
+    if (features & Sse2)
+        return accumulate32Sse2;
+#endif
+
+#ifdef GE_AUDIO_NEON
+    if (features & Neon)
+        return accumulate32Neon;
+#endif
+
+    return accumulate32Scalar;
+}
+
+
+/*!
+  Returns the fastest 32-bit bus clamp function supported by the CPU.
+*/
+CLAMP_FUNCTION_TYPE AudioKernels::clampFunction()
+{
+    const int features(cpuFeatures());
+    Q_UNUSED(features);
+
+#ifdef GE_AUDIO_SSE2
+    if (features & Sse2)
+        return clampSse2;
+#endif
+
+#ifdef GE_AUDIO_NEON
+    if (features & Neon)
+        return clampNeon;
+#endif
+
+    return clampScalar;
+}
+
+
+/*!
+  Allocates a sample buffer of \a size bytes aligned to
+  GEAudioBufferAlignment so that the SIMD implementations can use aligned
+  loads. The buffer must be released with freeBuffer().
+*/
+void *AudioKernels::allocateBuffer(int size)
+{
+    return qMallocAligned(size, GEAudioBufferAlignment);
+}
+
+
+/*!
+  Releases \a buffer allocated with allocateBuffer().
+*/
+void AudioKernels::freeBuffer(void *buffer)
+{
+    if (buffer)
+        qFreeAligned(buffer);
+}
+
+
+/*!
+  Adds \a length samples of \a source, scaled by \a fixedVolume (4096 being
+  100 %), to \a target. Both the scaled sample and the result are saturated
+  to the range of AUDIO_SAMPLE_TYPE instead of wrapping around, exactly like
+  the SIMD implementations do.
+*/
+void AudioKernels::accumulateScalar(AUDIO_SAMPLE_TYPE *target,
+                                    const AUDIO_SAMPLE_TYPE *source,
+                                    int length,
+                                    int fixedVolume)
+{
+    AUDIO_SAMPLE_TYPE *t_target = target + length;
+    int mixed(0);
+
+    while (target != t_target) {
+        mixed = (((*source) * fixedVolume) >> 12);
+
+        if (mixed > 32767)
+            mixed = 32767;
+        else if (mixed < -32768)
+            mixed = -32768;
+
+        mixed += *target;
+
+        if (mixed > 32767)
+            mixed = 32767;
+        else if (mixed < -32768)
+            mixed = -32768;
+
+        *target = (AUDIO_SAMPLE_TYPE)mixed;
+        target++;
+        source++;
+    }
+}
+
+
+/*!
+  Adds \a length samples of \a source, scaled by \a fixedVolume (4096 being
+  100 %), to the 32-bit bus \a target. No saturation is needed since the
+  bus has enough headroom for thousands of full scale sources.
+*/
+void AudioKernels::accumulate32Scalar(qint32 *target,
+                                      const AUDIO_SAMPLE_TYPE *source,
+                                      int length,
+                                      int fixedVolume)
+{
+    qint32 *t_target = target + length;
+
+    while (target != t_target) {
+        *target += (((*source) * fixedVolume) >> 12);
+        target++;
+        source++;
+    }
+}
+
+
+/*!
+  Converts \a length values of the 32-bit bus \a source into \a target,
+  saturating them to the range of AUDIO_SAMPLE_TYPE.
+*/
+void AudioKernels::clampScalar(AUDIO_SAMPLE_TYPE *target,
+                               const qint32 *source,
+                               int length)
+{
+    AUDIO_SAMPLE_TYPE *t_target = target + length;
+    qint32 value(0);
+
+    while (target != t_target) {
+        value = *source;
+
+        if (value > 32767)
+            value = 32767;
+        else if (value < -32768)
+            value = -32768;
+
+        *target = (AUDIO_SAMPLE_TYPE)value;
+        target++;
+        source++;
+    }
+}
+
+
+#ifdef GE_AUDIO_SSE2
+/*!
+  SSE2 implementation of accumulateScalar(). Processes eight samples at a
+  time and uses aligned loads for \a source if it is aligned to
+  GEAudioBufferAlignment.
+*/
+void AudioKernels::accumulateSse2(AUDIO_SAMPLE_TYPE *target,
+                                  const AUDIO_SAMPLE_TYPE *source,
+                                  int length,
+                                  int fixedVolume)
+{
+    if (fixedVolume > GEMaxSimdVolume) {
+        accumulateScalar(target, source, length, fixedVolume);
+        return;
+    }
+
+    const __m128i volume = _mm_set1_epi16((short)fixedVolume);
+    const bool aligned(((quintptr)source & (GEAudioBufferAlignment - 1)) == 0);
+    const int blocks(length & ~7);
+    __m128i s, lo, hi, mixed;
+
+    for (int i = 0; i < blocks; i += 8) {
+        if (aligned)
+            s = _mm_load_si128((const __m128i*)(source + i));
+        else
+            s = _mm_loadu_si128((const __m128i*)(source + i));
+
+        // 16 x 16 -> 32 bit products, scaled back to 16 bits with saturation.
+        lo = _mm_mullo_epi16(s, volume);
+        hi = _mm_mulhi_epi16(s, volume);
+        mixed = _mm_packs_epi32(
+            _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 12),
+            _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 12));
+
+        _mm_storeu_si128((__m128i*)(target + i),
+            _mm_adds_epi16(_mm_loadu_si128((const __m128i*)(target + i)),
+                           mixed));
+    }
+
+    // The remaining samples.
+    accumulateScalar(target + blocks, source + blocks, length - blocks,
+                     fixedVolume);
+}
+
+
+/*!
+  SSE2 implementation of accumulate32Scalar(). \a target must be aligned to
+  GEAudioBufferAlignment.
+*/
+void AudioKernels::accumulate32Sse2(qint32 *target,
+                                    const AUDIO_SAMPLE_TYPE *source,
+                                    int length,
+                                    int fixedVolume)
+{
+    if (fixedVolume > GEMaxSimdVolume) {
+        accumulate32Scalar(target, source, length, fixedVolume);
+        return;
+    }
+
+    const __m128i volume = _mm_set1_epi16((short)fixedVolume);
+    const int blocks(length & ~7);
+    __m128i s, lo, hi;
+
+    for (int i = 0; i < blocks; i += 8) {
+        s = _mm_loadu_si128((const __m128i*)(source + i));
+
+        // 16 x 16 -> 32 bit products.
+        lo = _mm_mullo_epi16(s, volume);
+        hi = _mm_mulhi_epi16(s, volume);
+
+        _mm_store_si128((__m128i*)(target + i),
+            _mm_add_epi32(_mm_load_si128((const __m128i*)(target + i)),
+                          _mm_srai_epi32(_mm_unpacklo_epi16(lo, hi), 12)));
+
+        _mm_store_si128((__m128i*)(target + i + 4),
+            _mm_add_epi32(_mm_load_si128((const __m128i*)(target + i + 4)),
+                          _mm_srai_epi32(_mm_unpackhi_epi16(lo, hi), 12)));
+    }
+
+    // The remaining samples.
+    accumulate32Scalar(target + blocks, source + blocks, length - blocks,
+                       fixedVolume);
+}
+
+
+/*!
+  SSE2 implementation of clampScalar(). \a source must be aligned to
+  GEAudioBufferAlignment.
+*/
+void AudioKernels::clampSse2(AUDIO_SAMPLE_TYPE *target,
+                             const qint32 *source,
+                             int length)
+{
+    const int blocks(length & ~7);
+
+    for (int i = 0; i < blocks; i += 8) {
+        _mm_storeu_si128((__m128i*)(target + i),
+            _mm_packs_epi32(_mm_load_si128((const __m128i*)(source + i)),
+                            _mm_load_si128((const __m128i*)(source + i + 4))));
+    }
+
+    // The remaining samples.
+    clampScalar(target + blocks, source + blocks, length - blocks);
+}
+#endif // GE_AUDIO_SSE2
+
+
+#ifdef GE_AUDIO_NEON
+/*!
+  NEON implementation of accumulateScalar(). Processes eight samples at a
+  time.
+*/
+void AudioKernels::accumulateNeon(AUDIO_SAMPLE_TYPE *target,
+                                  const AUDIO_SAMPLE_TYPE *source,
+                                  int length,
+                                  int fixedVolume)
+{
+    if (fixedVolume > GEMaxSimdVolume) {
+        accumulateScalar(target, source, length, fixedVolume);
+        return;
+    }
+
+    const int16x4_t volume = vdup_n_s16((short)fixedVolume);
+    const int blocks(length & ~7);
+    int16x8_t s, mixed;
+
+    for (int i = 0; i < blocks; i += 8) {
+        s = vld1q_s16(source + i);
+
+        // 16 x 16 -> 32 bit products, scaled back to 16 bits with saturation.
+        mixed = vcombine_s16(
+            vqshrn_n_s32(vmull_s16(vget_low_s16(s), volume), 12),
+            vqshrn_n_s32(vmull_s16(vget_high_s16(s), volume), 12));
+
+        vst1q_s16(target + i, vqaddq_s16(vld1q_s16(target + i), mixed));
+    }
+
+    // The remaining samples.
+    accumulateScalar(target + blocks, source + blocks, length - blocks,
+                     fixedVolume);
+}
+
+
+/*!
+  NEON implementation of accumulate32Scalar().
+*/
+void AudioKernels::accumulate32Neon(qint32 *target,
+                                    const AUDIO_SAMPLE_TYPE *source,
+                                    int length,
+                                    int fixedVolume)
+{
+    if (fixedVolume > GEMaxSimdVolume) {
+        accumulate32Scalar(target, source, length, fixedVolume);
+        return;
+    }
+
+    const int16x4_t volume = vdup_n_s16((short)fixedVolume);
+    const int blocks(length & ~7);
+    int16x8_t s;
+
+    for (int i = 0; i < blocks; i += 8) {
+        s = vld1q_s16(source + i);
+
+        vst1q_s32(target + i,
+            vaddq_s32(vld1q_s32(target + i),
+                      vshrq_n_s32(vmull_s16(vget_low_s16(s), volume), 12)));
+
+        vst1q_s32(target + i + 4,
+            vaddq_s32(vld1q_s32(target + i + 4),
+                      vshrq_n_s32(vmull_s16(vget_high_s16(s), volume), 12)));
+    }
+
+    // The remaining samples.
+    accumulate32Scalar(target + blocks, source + blocks, length - blocks,
+                       fixedVolume);
+}
+
+
+/*!
+  NEON implementation of clampScalar().
+*/
+void AudioKernels::clampNeon(AUDIO_SAMPLE_TYPE *target,
+                             const qint32 *source,
+                             int length)
+{
+    const int blocks(length & ~7);
+
+    for (int i = 0; i < blocks; i += 8) {
+        vst1q_s16(target + i,
+                  vcombine_s16(vqmovn_s32(vld1q_s32(source + i)),
+                               vqmovn_s32(vld1q_s32(source + i + 4))));
+    }
+
+    // The remaining samples.
+    clampScalar(target + blocks, source + blocks, length - blocks);
+}
+#endif // GE_AUDIO_NEON
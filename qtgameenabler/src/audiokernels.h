@@ -0,0 +1,109 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#ifndef GEAUDIOKERNELS_H
+#define GEAUDIOKERNELS_H
+
+#include "audiosourceif.h"
+
+// The SIMD implementations are compiled in when the compiler targets an
+// instruction set containing them. The implementation actually used is
+// selected at runtime, see AudioKernels::accumulateFunction().
+#ifndef GE_AUDIO_NO_SIMD
+    #if defined(__SSE2__) || defined(_M_X64) || \
+        (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+        #define GE_AUDIO_SSE2
+    #elif defined(__ARM_NEON__) || defined(__ARM_NEON)
+        #define GE_AUDIO_NEON
+    #endif
+#endif
+
+
+namespace GE {
+
+// Prototype function for accumulating a block of samples with gain
+typedef void (*ACCUMULATE_FUNCTION_TYPE)(AUDIO_SAMPLE_TYPE *target,
+                                         const AUDIO_SAMPLE_TYPE *source,
+                                         int length,
+                                         int fixedVolume);
+
+// Prototype function for accumulating a block of samples into a 32-bit bus
+typedef void (*ACCUMULATE32_FUNCTION_TYPE)(qint32 *target,
+                                           const AUDIO_SAMPLE_TYPE *source,
+                                           int length,
+                                           int fixedVolume);
+
+// Prototype function for converting a 32-bit bus into output samples
+typedef void (*CLAMP_FUNCTION_TYPE)(AUDIO_SAMPLE_TYPE *target,
+                                    const qint32 *source,
+                                    int length);
+
+// Constants
+const int GEAudioBufferAlignment(16); // In bytes
+
+
+class AudioKernels
+{
+public: // Data types
+
+    enum CpuFeature {
+        NoFeatures = 0x0,
+        Sse2 = 0x1,
+        Neon = 0x2
+    };
+
+public:
+    static int cpuFeatures();
+    static ACCUMULATE_FUNCTION_TYPE accumulateFunction();
+    static ACCUMULATE32_FUNCTION_TYPE accumulate32Function();
+    static CLAMP_FUNCTION_TYPE clampFunction();
+
+    static void *allocateBuffer(int size);
+    static void freeBuffer(void *buffer);
+
+    // Implementations of the kernels
+    static void accumulateScalar(AUDIO_SAMPLE_TYPE *target,
+                                 const AUDIO_SAMPLE_TYPE *source,
+                                 int length,
+                                 int fixedVolume);
+    static void accumulate32Scalar(qint32 *target,
+                                   const AUDIO_SAMPLE_TYPE *source,
+                                   int length,
+                                   int fixedVolume);
+    static void clampScalar(AUDIO_SAMPLE_TYPE *target,
+                            const qint32 *source,
+                            int length);
+#ifdef GE_AUDIO_SSE2
+    static void accumulateSse2(AUDIO_SAMPLE_TYPE *target,
+                               const AUDIO_SAMPLE_TYPE *source,
+                               int length,
+                               int fixedVolume);
+    static void accumulate32Sse2(qint32 *target,
+                                 const AUDIO_SAMPLE_TYPE *source,
+                                 int length,
+                                 int fixedVolume);
+    static void clampSse2(AUDIO_SAMPLE_TYPE *target,
+                          const qint32 *source,
+                          int length);
+#endif
+#ifdef GE_AUDIO_NEON
+    static void accumulateNeon(AUDIO_SAMPLE_TYPE *target,
+                               const AUDIO_SAMPLE_TYPE *source,
+                               int length,
+                               int fixedVolume);
+    static void accumulate32Neon(qint32 *target,
+                                 const AUDIO_SAMPLE_TYPE *source,
+                                 int length,
+                                 int fixedVolume);
+    static void clampNeon(AUDIO_SAMPLE_TYPE *target,
+                          const qint32 *source,
+                          int length);
+#endif
+};
+
+} // namespace GE
+
+#endif // GEAUDIOKERNELS_H
@@ -6,6 +6,8 @@
 
 #include "audiomixer.h"
 #include <memory.h>
+#include <QtAlgorithms>
+#include "profiler.h"
 #include "trace.h" // For debug macros
 
 using namespace GE;
@@ -19,14 +21,54 @@ using namespace GE;
 
 
 /*!
-  Constructor.
+  Constructor. The sources are mixed directly into the output samples.
 */
 AudioMixer::AudioMixer(QObject *parent)
     : AudioSource(parent),
       m_mixingBuffer(0),
+      m_busBuffer(0),
+      m_accumulateFunction(AudioKernels::accumulateFunction()),
+      m_accumulate32Function(AudioKernels::accumulate32Function()),
+      m_clampFunction(AudioKernels::clampFunction()),
+      m_mixingBus(SampleBus),
+      m_sourceCount(0),
+      m_sourceCapacity(0),
+      m_pendingReclaimCount(0),
+      m_maxRealVoices(0),
+      m_realVoiceCount(0),
+      m_virtualVoiceCount(0),
       m_mixingBufferLength(0),
       m_fixedGeneralVolume((int)GEMaxAudioVolumeValue)
 {
+    reserveSources(2 * GEMixerCommandQueueSize);
+}
+
+
+/*!
+  Constructor. The sources are mixed using the given mixing \a bus. With
+  WideBus, every source is accumulated into an internal 32-bit bus and the
+  result is clamped to AUDIO_SAMPLE_TYPE only once per mixed block. This
+  avoids clipping the intermediate sums and allows mixing more sources
+  before their volumes have to be lowered.
+*/
+AudioMixer::AudioMixer(MixingBus bus, QObject *parent)
+    : AudioSource(parent),
+      m_mixingBuffer(0),
+      m_busBuffer(0),
+      m_accumulateFunction(AudioKernels::accumulateFunction()),
+      m_accumulate32Function(AudioKernels::accumulate32Function()),
+      m_clampFunction(AudioKernels::clampFunction()),
+      m_mixingBus(bus),
+      m_sourceCount(0),
+      m_sourceCapacity(0),
+      m_pendingReclaimCount(0),
+      m_maxRealVoices(0),
+      m_realVoiceCount(0),
+      m_virtualVoiceCount(0),
+      m_mixingBufferLength(0),
+      m_fixedGeneralVolume((int)GEMaxAudioVolumeValue)
+{
+    reserveSources(2 * GEMixerCommandQueueSize);
 }
 
 
@@ -36,11 +78,9 @@ AudioMixer::AudioMixer(QObject *parent)
 AudioMixer::~AudioMixer()
 {
     destroyList();
+    reclaimFinishedSources();
 
-    if (m_mixingBuffer) {
-        delete [] m_mixingBuffer;
-        m_mixingBuffer = 0;
-    }
+    reallocateMixingBuffers(0);
 }
 
 
@@ -49,7 +89,7 @@ AudioMixer::~AudioMixer()
 */
 float AudioMixer::absoluteVolume() const
 {
-    return (float)m_fixedGeneralVolume / 4096.0f;
+    return (float)(int)m_fixedGeneralVolume / 4096.0f;
 }
 
 
@@ -58,14 +98,18 @@ float AudioMixer::absoluteVolume() const
 */
 float AudioMixer::generalVolume()
 {
-    return (float)m_fixedGeneralVolume *
+    return (float)(int)m_fixedGeneralVolume *
            (float)audioSourceCount() / GEMaxAudioVolumeValue;
 }
 
 
 /*!
-  Adds \a source to the list of audio sources. Returns true if the given audio
-  source was added into the list, false otherwise.
+  Adds \a source to the list of audio sources. The source is added without
+  blocking and is mixed starting from the next mixed block. Returns true if
+  the given audio source was added, false otherwise.
+
+  Note: When the number of sources outgrows the memory reserved for them,
+  blocks once to reserve more, see reserveSources().
 */
 bool AudioMixer::addAudioSource(AudioSource *source)
 {
@@ -75,35 +119,68 @@ bool AudioMixer::addAudioSource(AudioSource *source)
         return false;
     }
 
-    QMutexLocker locker(&m_mutex);
-    Q_UNUSED(locker); // To prevent warnings.
-    m_sourceList.push_back(source);
-    return true;
+    // The list may grow by all the queued additions before the next block.
+    reserveSources(m_sourceCount + GEMixerCommandQueueSize);
+
+    return pushCommand(AddSource, source);
 }
 
 
 /*!
-  Removes \a source from the list of audio sources. Returns true if
-  found and removed, false otherwise.
+  Removes \a source from the list of audio sources. Blocks until the block
+  being mixed, if any, is ready, so the source is no longer accessed by the
+  mixer when this method returns. Returns true if the given audio source
+  was removed, false if it was not in the list.
 
-  Note: The removed item is not deleted!
+  Note: The removed item is not deleted! See removeAudioSourceAsync() for
+  removing without blocking.
 */
 bool AudioMixer::removeAudioSource(AudioSource *source)
 {
+    if (!source)
+        return false;
+
     QMutexLocker locker(&m_mutex);
     Q_UNUSED(locker); // To prevent warnings
-    return m_sourceList.removeOne(source);
+
+    // Apply the pending additions first, the source may be among them.
+    processCommands();
+
+    const bool removed(m_sourceList.removeOne(source));
+    m_sourceCount = m_sourceList.count();
+    return removed;
+}
+
+
+/*!
+  Removes \a source from the list of audio sources without blocking. The
+  source is removed at the beginning of the next mixed block. Returns true
+  if the removal was queued, false otherwise; the source not being in the
+  list is not detected.
+
+  Note: The removed item is not deleted! Since the source may still be mixed
+  when this method returns, call flushCommands() before deleting it.
+*/
+bool AudioMixer::removeAudioSourceAsync(AudioSource *source)
+{
+    if (!source)
+        return false;
+
+    return pushCommand(RemoveSource, source);
 }
 
 
 /*!
-  Destroys all the sources in the list.
+  Destroys all the sources in the list, including the ones still waiting to
+  be added.
 */
 void AudioMixer::destroyList()
 {
     QMutexLocker locker(&m_mutex);
     Q_UNUSED(locker); // To prevent warnings
 
+    processCommands();
+
     QList<AudioSource*>::iterator iter;
 
     for (iter = m_sourceList.begin(); iter != m_sourceList.end(); iter++) {
@@ -111,17 +188,158 @@ void AudioMixer::destroyList()
     }
 
     m_sourceList.clear();
+    m_sourceCount = 0;
 }
 
 
 /*!
-  Returns the audio source list count.
+  Applies the pending additions and removals immediately. Unlike the other
+  methods, this method blocks until the block being mixed, if any, is ready.
+  After this method returns, the removed sources are no longer accessed by
+  the mixer and can be safely deleted.
 */
-int AudioMixer::audioSourceCount()
+void AudioMixer::flushCommands()
 {
     QMutexLocker locker(&m_mutex);
     Q_UNUSED(locker); // To prevent warnings
-    return m_sourceList.count();
+    processCommands();
+}
+
+
+/*!
+  Returns the audio source list count. The count is updated when the mixer
+  applies the pending additions and removals.
+*/
+int AudioMixer::audioSourceCount() const
+{
+    return m_sourceCount;
+}
+
+
+/*!
+  Returns the number of finished sources removed from the list but not yet
+  deleted by reclaimFinishedSources().
+*/
+int AudioMixer::pendingReclaimCount() const
+{
+    return m_pendingReclaimCount;
+}
+
+
+/*!
+  Returns the maximum number of sources mixed per block or 0 if the number
+  is not limited.
+*/
+int AudioMixer::maxRealVoices() const
+{
+    return m_maxRealVoices;
+}
+
+
+/*!
+  Limits the number of sources mixed per block to \a count. If there are
+  more audible sources, the ones with the highest priority and, within the
+  same priority, the highest volume are mixed. The rest become virtual
+  voices: their position keeps advancing but they are not mixed, until they
+  rank high enough again. Sources with zero volume are always virtual.
+  Use 0 to remove the limit.
+*/
+void AudioMixer::setMaxRealVoices(int count)
+{
+    m_maxRealVoices = qMax(0, count);
+}
+
+
+/*!
+  Returns the number of sources mixed in the latest block.
+*/
+int AudioMixer::realVoiceCount() const
+{
+    return m_realVoiceCount;
+}
+
+
+/*!
+  Returns the number of sources skipped (not mixed) in the latest block.
+*/
+int AudioMixer::virtualVoiceCount() const
+{
+    return m_virtualVoiceCount;
+}
+
+
+/*!
+  Queues a command of \a type for \a source. If the queue is full (for
+  example, because the audio output is not running and nobody is pulling
+  audio), the pending commands are applied immediately. Returns true if
+  successful, false otherwise.
+*/
+bool AudioMixer::pushCommand(CommandType type, AudioSource *source)
+{
+    Command command;
+    command.type = type;
+    command.source = source;
+
+    if (m_commandQueue.push(command))
+        return true;
+
+    DEBUG_INFO("The command queue is full, flushing it.");
+    flushCommands();
+    return m_commandQueue.push(command);
+}
+
+
+/*!
+  Reserves the memory for \a count sources in the source list and in the
+  voice selection, so that the mixing does not allocate memory. The
+  capacity is doubled as needed, which blocks until the block being mixed,
+  if any, is ready.
+*/
+void AudioMixer::reserveSources(int count)
+{
+    if (count <= (int)m_sourceCapacity)
+        return;
+
+    QMutexLocker locker(&m_mutex);
+    Q_UNUSED(locker); // To prevent warnings
+
+    int capacity(qMax((int)m_sourceCapacity, 1));
+
+    while (capacity < count)
+        capacity <<= 1;
+
+    if (capacity == (int)m_sourceCapacity) {
+        // Reserved by another thread meanwhile.
+        return;
+    }
+
+    m_sourceList.reserve(capacity);
+    m_voiceRanks.reserve(capacity);
+    m_realVoices.reserve(capacity);
+    m_sourceCapacity = capacity;
+}
+
+
+/*!
+  Applies the queued commands to the source list. Must be called with
+  m_mutex locked.
+*/
+void AudioMixer::processCommands()
+{
+    Command command;
+
+    while (m_commandQueue.pop(command)) {
+        switch (command.type) {
+        case AddSource:
+            m_sourceList.push_back(command.source);
+            break;
+        case RemoveSource:
+            m_sourceList.removeOne(command.source);
+            break;
+        }
+    }
+
+    m_sourceCount = m_sourceList.count();
 }
 
 
@@ -133,29 +351,35 @@ int AudioMixer::audioSourceCount()
 */
 int AudioMixer::pullAudio(AUDIO_SAMPLE_TYPE *target, int bufferLength)
 {
+    GE_PROFILE_ZONE("AudioMixer::pullAudio");
     QMutexLocker locker(&m_mutex);
     Q_UNUSED(locker); // To prevent warnings
 
+    // Apply the additions and removals made since the previous block.
+    processCommands();
+
     if (m_sourceList.isEmpty()) {
         DEBUG_INFO("No items in the source list!");
+        m_realVoiceCount = 0;
+        m_virtualVoiceCount = 0;
         return 0;
     }
 
-    if (m_mixingBufferLength < bufferLength) {
-        if (m_mixingBuffer)
-            delete [] m_mixingBuffer;
+    if (m_mixingBufferLength < bufferLength)
+        reallocateMixingBuffers(bufferLength);
 
-        m_mixingBufferLength = bufferLength;
-        m_mixingBuffer = new AUDIO_SAMPLE_TYPE[m_mixingBufferLength];
-    }
+    if (m_mixingBus == WideBus)
+        memset(m_busBuffer, 0, sizeof(qint32) * bufferLength);
+    else
+        memset(target, 0, sizeof(AUDIO_SAMPLE_TYPE) *bufferLength);
 
-    memset(target, 0, sizeof(AUDIO_SAMPLE_TYPE) *bufferLength);
-
-    AUDIO_SAMPLE_TYPE *t;
-    AUDIO_SAMPLE_TYPE *t_target;
-    AUDIO_SAMPLE_TYPE *s;
+    // Decide which of the sources are mixed in this block.
+    selectRealVoices();
 
+    // The volume may be changed by other threads while mixing.
+    const int fixedVolume(m_fixedGeneralVolume);
     QList<AudioSource*>::iterator iter(m_sourceList.begin());
+    int index(0);
 
     while (iter != m_sourceList.end()) {
         if (!(*iter)) {
@@ -164,33 +388,47 @@ int AudioMixer::pullAudio(AUDIO_SAMPLE_TYPE *target, int bufferLength)
             continue;
         }
 
-        // Process the list item.
-        int mixed = (*iter)->pullAudio(m_mixingBuffer, bufferLength);
+        int mixed(0);
+
+        // Process the list item. Virtual voices are only advanced.
+        if (m_realVoices.at(index))
+            mixed = (*iter)->pullAudio(m_mixingBuffer, bufferLength);
+        else
+            (*iter)->skipAudio(m_mixingBuffer, bufferLength);
 
         if (mixed > 0) {
-            // Mix to main.
-            t = target;
-            t_target = t + mixed;
-            s = m_mixingBuffer;
-
-            while (t != t_target) {
-                *t += (((*s) * m_fixedGeneralVolume) >> 12);
-                t++;
-                s++;
+            if (m_mixingBus == WideBus) {
+                // Mix to the bus, clamped after all the sources are mixed.
+                (m_accumulate32Function)(m_busBuffer, m_mixingBuffer, mixed,
+                                         fixedVolume);
+            }
+            else {
+                // Mix to main with saturation.
+                (m_accumulateFunction)(target, m_mixingBuffer, mixed,
+                                       fixedVolume);
             }
         }
 
-        if ((*iter)->canBeDestroyed()) {
-            // Auto-destroy the current audio source.
-            //
-            // Note: The auto-destroy feature is undergoing testing and may
-            // cause unpredictable crashes with some use cases!
-            delete *iter;
+        if ((*iter)->canBeDestroyed() && m_reclaimQueue.push(*iter)) {
+            // Auto-destroy the current audio source. Deleting is left to
+            // reclaimFinishedSources() to keep the memory allocator and the
+            // QObject destruction out of the audio thread. If the reclaim
+            // queue is full, the source is kept and retried with the next
+            // block.
+            m_pendingReclaimCount.ref();
             iter = m_sourceList.erase(iter);
+            m_sourceCount = m_sourceList.count();
         }
         else {
             iter++;
         }
+
+        index++;
+    }
+
+    if (m_mixingBus == WideBus) {
+        // Convert the bus into the output samples.
+        (m_clampFunction)(target, m_busBuffer, bufferLength);
     }
 
     //DEBUG_INFO("Done, will return buffer length: " << bufferLength);
@@ -198,13 +436,125 @@ int AudioMixer::pullAudio(AUDIO_SAMPLE_TYPE *target, int bufferLength)
 }
 
 
+/*!
+  Ranks the sources by priority and volume and marks the ones to be mixed in
+  m_realVoices. Must be called with m_mutex locked.
+*/
+void AudioMixer::selectRealVoices()
+{
+    const int count(m_sourceList.count());
+    const int maxReal(m_maxRealVoices);
+    int audible(0);
+
+    // Within the capacity set by reserveSources(), no memory is allocated.
+    m_voiceRanks.resize(count);
+    m_realVoices.resize(count);
+
+    for (int i = 0; i < count; i++) {
+        AudioSource *source = m_sourceList.at(i);
+        const int volume(source ? source->audibleVolume() : 0);
+        m_realVoices[i] = false;
+
+        if (volume <= 0) {
+            // Silent, no need to mix.
+            continue;
+        }
+
+        VoiceRank &rank = m_voiceRanks[audible++];
+        rank.priority = source->priority();
+        rank.volume = volume;
+        rank.index = i;
+    }
+
+    int realCount(audible);
+
+    if (maxReal > 0 && audible > maxReal) {
+        // Over the budget, keep the most important ones.
+        qSort(m_voiceRanks.begin(), m_voiceRanks.begin() + audible,
+              voiceRankLessThan);
+        realCount = maxReal;
+    }
+
+    for (int i = 0; i < realCount; i++)
+        m_realVoices[m_voiceRanks.at(i).index] = true;
+
+    m_realVoiceCount = realCount;
+    m_virtualVoiceCount = count - realCount;
+}
+
+
+/*!
+  Orders the voices by descending priority and volume. The older sources go
+  first among equals so that the selection does not flicker between blocks.
+*/
+bool AudioMixer::voiceRankLessThan(const VoiceRank &a, const VoiceRank &b)
+{
+    if (a.priority != b.priority)
+        return (a.priority > b.priority);
+
+    if (a.volume != b.volume)
+        return (a.volume > b.volume);
+
+    return (a.index < b.index);
+}
+
+
+/*!
+  (Re)allocates the mixing buffers to hold \a bufferLength samples. The
+  buffers are aligned for the mixing kernels. If \a bufferLength is 0, the
+  buffers are released.
+*/
+void AudioMixer::reallocateMixingBuffers(int bufferLength)
+{
+    AudioKernels::freeBuffer(m_mixingBuffer);
+    AudioKernels::freeBuffer(m_busBuffer);
+    m_mixingBuffer = 0;
+    m_busBuffer = 0;
+    m_mixingBufferLength = bufferLength;
+
+    if (m_mixingBufferLength <= 0)
+        return;
+
+    m_mixingBuffer = (AUDIO_SAMPLE_TYPE*)AudioKernels::allocateBuffer(
+        sizeof(AUDIO_SAMPLE_TYPE) * m_mixingBufferLength);
+
+    if (m_mixingBus == WideBus) {
+        m_busBuffer = (qint32*)AudioKernels::allocateBuffer(
+            sizeof(qint32) * m_mixingBufferLength);
+    }
+}
+
+
 /*!
   Sets \a volume as the absolute volume.
 */
 void AudioMixer::setAbsoluteVolume(float volume)
 {
-    m_fixedGeneralVolume = GEMaxAudioVolumeValue * volume;
-    emit absoluteVolumeChanged(m_fixedGeneralVolume);
+    m_fixedGeneralVolume = (int)(GEMaxAudioVolumeValue * volume);
+    emit absoluteVolumeChanged((int)m_fixedGeneralVolume);
+}
+
+
+/*!
+  Deletes the sources which have finished playing and have been removed from
+  the list by the mixer. Should be called periodically from the thread
+  owning the mixer, for example once per frame or from a timer. GameWindow
+  calls this method for its own mixer on every rendered frame.
+
+  Returns the number of deleted sources.
+*/
+int AudioMixer::reclaimFinishedSources()
+{
+    AudioSource *source(0);
+    int count(0);
+
+    while (m_reclaimQueue.pop(source)) {
+        delete source;
+        m_pendingReclaimCount.deref();
+        count++;
+    }
+
+    return count;
 }
 
 
@@ -218,13 +568,13 @@ void AudioMixer::setGeneralVolume(float volume)
 
     // Safety checks for possible division by zero error.
     if (volume == 0) {
-        m_fixedGeneralVolume = 0.0f;
+        m_fixedGeneralVolume = 0;
     }
     else if (sourceCount) {
         m_fixedGeneralVolume =
-            (GEMaxAudioVolumeValue / (float)audioSourceCount() * volume);
+            (int)(GEMaxAudioVolumeValue / (float)sourceCount * volume);
     }
 
-    emit generalVolumeChanged(m_fixedGeneralVolume);
+    emit generalVolumeChanged((int)m_fixedGeneralVolume);
 }
 
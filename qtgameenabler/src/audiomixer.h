@@ -7,34 +7,85 @@
 #ifndef GEAUDIOMIXER_H
 #define GEAUDIOMIXER_H
 
+#include <QAtomicInt>
 #include <QMutex>
+#include <QVector>
+#include "audiokernels.h"
 #include "audiosourceif.h"
+#include "lockfreequeue.h"
 
 
 namespace GE {
 
+// Constants
+const int GEMixerCommandQueueSize(256); // Must be a power of two
+const int GEMixerReclaimQueueSize(256); // Must be a power of two
+
 class AudioMixer : public AudioSource
 {
     Q_OBJECT
 
+public: // Data types
+
+    enum MixingBus {
+        SampleBus = 0, // Sources are summed directly into the output
+        WideBus = 1 // Sources are summed into a 32-bit bus clamped once
+    };
+
+protected: // Data types
+
+    enum CommandType {
+        AddSource = 0,
+        RemoveSource = 1
+    };
+
+    struct Command {
+        CommandType type;
+        AudioSource *source;
+    };
+
+    struct VoiceRank {
+        int priority;
+        int volume;
+        int index; // In m_sourceList
+    };
+
 public:
     explicit AudioMixer(QObject *parent = 0);
+    explicit AudioMixer(MixingBus bus, QObject *parent = 0);
     virtual ~AudioMixer();
 
 public:
+    inline MixingBus mixingBus() const { return m_mixingBus; }
     float absoluteVolume() const;
     float generalVolume();
     bool addAudioSource(AudioSource *source);
     bool removeAudioSource(AudioSource *source);
+    bool removeAudioSourceAsync(AudioSource *source);
     void destroyList();
-    int audioSourceCount();
+    void flushCommands();
+    int audioSourceCount() const;
+    int pendingReclaimCount() const;
+    int maxRealVoices() const;
+    void setMaxRealVoices(int count);
+    int realVoiceCount() const;
+    int virtualVoiceCount() const;
 
 public: // From AudioSource
     int pullAudio(AUDIO_SAMPLE_TYPE *target, int bufferLength);
 
+protected:
+    bool pushCommand(CommandType type, AudioSource *source);
+    void reserveSources(int count);
+    void processCommands();
+    void selectRealVoices();
+    static bool voiceRankLessThan(const VoiceRank &a, const VoiceRank &b);
+    void reallocateMixingBuffers(int bufferLength);
+
 public slots:
     void setAbsoluteVolume(float volume);
     void setGeneralVolume(float volume);
+    int reclaimFinishedSources();
 
 signals:
     void absoluteVolumeChanged(float volume);
@@ -42,10 +93,25 @@ signals:
 
 protected: // Data
     QList<AudioSource*> m_sourceList; // Owned
+    QVector<VoiceRank> m_voiceRanks; // Reserved, see reserveSources()
+    QVector<bool> m_realVoices; // Indexed as m_sourceList, reserved
+    MpscQueue<Command, GEMixerCommandQueueSize> m_commandQueue;
+    SpscQueue<AudioSource*, GEMixerReclaimQueueSize> m_reclaimQueue;
     AUDIO_SAMPLE_TYPE *m_mixingBuffer; // Owned
-    QMutex m_mutex;
+    qint32 *m_busBuffer; // Owned, used with WideBus only
+    ACCUMULATE_FUNCTION_TYPE m_accumulateFunction;
+    ACCUMULATE32_FUNCTION_TYPE m_accumulate32Function;
+    CLAMP_FUNCTION_TYPE m_clampFunction;
+    MixingBus m_mixingBus;
+    QMutex m_mutex; // Guards m_sourceList, not taken by the game thread
+    QAtomicInt m_sourceCount;
+    QAtomicInt m_sourceCapacity; // Written with m_mutex locked
+    QAtomicInt m_pendingReclaimCount;
+    QAtomicInt m_maxRealVoices; // 0 for no limit
+    QAtomicInt m_realVoiceCount;
+    QAtomicInt m_virtualVoiceCount;
     int m_mixingBufferLength;
-    int m_fixedGeneralVolume;
+    QAtomicInt m_fixedGeneralVolume;
 };
 
 } // namespace GE
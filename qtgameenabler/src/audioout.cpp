@@ -12,6 +12,10 @@
 #include <QtMultimedia/qaudio.h>
 #include <QtMultimedia/qaudiodeviceinfo.h>
 
+#include "audioconfig.h"
+#include "audiopulldevice.h"
+#include "audioringbuffer.h"
+#include "profiler.h"
 #include "trace.h" // For debug macros
 
 #if defined(QTGAMEENABLER_USE_VOLUME_HACK) && defined(Q_OS_SYMBIAN)
@@ -19,15 +23,20 @@
 #endif
 
 // Constants
-const int GEDefaultChannelCount(2);
-const QString GEDefaultAudioCodec("audio/pcm");
-const QAudioFormat::Endian GEByteOrder(QAudioFormat::LittleEndian);
-const QAudioFormat::SampleType GESampleType(QAudioFormat::SignedInt);
 const int GEThreadSleepTime(1); // Milliseconds
+const int GEDefaultLeadTime(50); // Milliseconds
+const int GEMinLeadTime(5); // Milliseconds
+const int GEMaxLeadTime(500); // Milliseconds
 
 
 using namespace GE;
 
+#if defined(Q_OS_SYMBIAN) || defined(GE_AUDIO_PUSH_MODE)
+const AudioOut::OutputMode GEDefaultOutputMode(AudioOut::PushMode);
+#else
+const AudioOut::OutputMode GEDefaultOutputMode(AudioOut::PullMode);
+#endif
+
 
 /*!
   \class Audioout
@@ -37,57 +46,140 @@ using namespace GE;
 
 
 /*!
-  Constructor.
+  Constructor. Uses the default output mode of the platform: the push mode
+  with manual ticks on Symbian and the pull mode elsewhere. The push mode can
+  be forced by defining GE_AUDIO_PUSH_MODE.
 */
 AudioOut::AudioOut(AudioSource *source, QObject *parent /* = 0 */)
     : QThread(parent),
       m_audioOutput(0),
       m_outTarget(0),
+      m_pullDevice(0),
+      m_ringBuffer(0),
+      m_source(source),
+      m_sendBuffer(0),
+      m_sendBufferSize(0),
+      m_samplesMixed(0),
+      m_threadState(NotRunning),
+      m_usingThread(false),
+      m_outputMode(PushMode),
+      m_wakeupCount(0),
+      m_leadSamples(0),
+      m_leadTime(0)
+{
+    init(GEDefaultOutputMode);
+}
+
+
+/*!
+  Constructor. Uses the given output \a mode. If the pull mode cannot be
+  started, falls back to the push mode.
+*/
+AudioOut::AudioOut(AudioSource *source,
+                   OutputMode mode,
+                   QObject *parent /* = 0 */)
+    : QThread(parent),
+      m_audioOutput(0),
+      m_outTarget(0),
+      m_pullDevice(0),
+      m_ringBuffer(0),
       m_source(source),
       m_sendBuffer(0),
       m_sendBufferSize(0),
       m_samplesMixed(0),
       m_threadState(NotRunning),
-      m_usingThread(false)
+      m_usingThread(false),
+      m_outputMode(PushMode),
+      m_wakeupCount(0),
+      m_leadSamples(0),
+      m_leadTime(0)
+{
+    init(mode);
+}
+
+
+/*!
+  Destructor.
+*/
+AudioOut::~AudioOut()
 {
-    QAudioFormat format;
-    format.setFrequency(AUDIO_FREQUENCY);
-    format.setChannels(GEDefaultChannelCount);
-    format.setSampleSize(AUDIO_SAMPLE_BITS);
-    format.setCodec(GEDefaultAudioCodec);
-    format.setByteOrder(GEByteOrder);
-    format.setSampleType(GESampleType);
+    stopThread();
+
+    m_audioOutput->stop();
 
+    delete m_audioOutput;
+    delete m_pullDevice;
+    delete m_ringBuffer;
+    delete [] m_sendBuffer;
+}
+
+
+/*!
+  Creates the audio output and starts it in the given \a mode.
+*/
+void AudioOut::init(OutputMode mode)
+{
+    // The mixing rate defaults to the native rate of the device.
     QAudioDeviceInfo info(QAudioDeviceInfo::defaultOutputDevice());
+    QAudioFormat format(AudioConfig::format());
 
-    if (!info.isFormatSupported(format))
+    if (!info.isFormatSupported(format)) {
         format = info.nearestFormat(format);
 
+        // Mix at the rate the device accepts instead of having it resampled.
+        if (format.frequency() > 0)
+            AudioConfig::setSampleRate(format.frequency());
+
+        if (format.channels() != AudioConfig::channelCount() ||
+            format.sampleSize() != AudioConfig::sampleSize()) {
+            DEBUG_INFO("Warning: The device does not support the sample "
+                       "format of the mixer!");
+        }
+    }
+
     m_audioOutput = new QAudioOutput(info, format);
+    m_wakeupTimer.start();
 
-#if defined(Q_WS_MAEMO_5) || defined(Q_WS_MAEMO_6)
-    m_sendBufferSize = 4096 * 4;
-#else
-    m_audioOutput->setBufferSize(4096 * 4);
-#endif
+    // The ring is large enough for the maximum lead time.
+    m_ringBuffer = new AudioRingBuffer(
+        GEMaxLeadTime * AudioConfig::sampleRate() / 1000 *
+        AudioConfig::channelCount());
 
-    m_outTarget = m_audioOutput->start();
+    if (mode == PullMode) {
+        // The device calls AudioPullDevice::readData() whenever it needs
+        // more data, no polling is needed. The mixing is done ahead of time
+        // in the thread of this object and the device only copies the
+        // samples out of the ring.
+        m_pullDevice = new AudioPullDevice(m_ringBuffer);
+        setLeadTime(GEDefaultLeadTime);
 
 #if defined(Q_WS_MAEMO_5) || defined(Q_WS_MAEMO_6)
-    m_audioOutput->setBufferSize(4096 * 16);
-    m_sendBufferSize = 4096 * 8;
+        m_audioOutput->setBufferSize(4096 * 16);
 #else
-    m_audioOutput->setBufferSize(4096 * 4);
-    m_sendBufferSize = 4096 * 2;
+        m_audioOutput->setBufferSize(4096 * 4);
 #endif
 
-    DEBUG_INFO("Buffer size: " << m_audioOutput->bufferSize());
-    m_sendBuffer = new AUDIO_SAMPLE_TYPE[m_sendBufferSize];
+        m_audioOutput->start(m_pullDevice);
+
+        if (m_audioOutput->error() == QAudio::NoError) {
+            m_outputMode = PullMode;
+            DEBUG_INFO("Using the pull mode, buffer size: "
+                       << m_audioOutput->bufferSize());
+        }
+        else {
+            DEBUG_INFO("Failed to start the pull mode, using the push mode!");
+            stopThread();
+            m_audioOutput->stop();
+            delete m_pullDevice;
+            m_pullDevice = 0;
+            m_leadSamples = 0;
+            m_leadTime = 0;
+            m_ringBuffer->clear();
+        }
+    }
 
-#ifndef Q_OS_SYMBIAN
-    m_usingThread = true;
-    start();
-#else
+    if (!m_pullDevice)
+        startPushMode();
 
 #if defined(QTGAMEENABLER_USE_VOLUME_HACK) && defined(Q_OS_SYMBIAN)
     DEBUG_INFO("WARNING: Using the volume hack!");
@@ -111,34 +203,157 @@ AudioOut::AudioOut(AudioSource *source, QObject *parent /* = 0 */)
     CMMFDevSound *devSound = (CMMFDevSound*)(*temp);
     devSound->SetVolume(devSound->MaxVolume() * 6 / 10);
 #endif
+}
+
+
+/*!
+  Starts pushing the data to the audio output: from a polling thread, or on
+  Symbian, from manual tick() calls.
+*/
+void AudioOut::startPushMode()
+{
+    m_outputMode = PushMode;
+
+#if defined(Q_WS_MAEMO_5) || defined(Q_WS_MAEMO_6)
+    m_sendBufferSize = 4096 * 4;
+#else
+    m_audioOutput->setBufferSize(4096 * 4);
+#endif
+
+    m_outTarget = m_audioOutput->start();
+
+#if defined(Q_WS_MAEMO_5) || defined(Q_WS_MAEMO_6)
+    m_audioOutput->setBufferSize(4096 * 16);
+    m_sendBufferSize = 4096 * 8;
+#else
+    m_audioOutput->setBufferSize(4096 * 4);
+    m_sendBufferSize = 4096 * 2;
+#endif
 
-#endif // ifndef Q_OS_SYMBIAN - else
+    DEBUG_INFO("Using the push mode, buffer size: "
+               << m_audioOutput->bufferSize());
+    m_sendBuffer = new AUDIO_SAMPLE_TYPE[m_sendBufferSize];
+
+#ifndef Q_OS_SYMBIAN
+    // The thread renders ahead and pushes the data to the device.
+    m_usingThread = true;
+    setLeadTime(GEDefaultLeadTime);
+    startThread();
+#endif
 }
 
 
 /*!
-  Destructor.
+  Returns the average number of times per second the audio output has woken
+  up to render audio since the previous call: the readData() calls of the
+  pull device in the pull mode and the tick() calls in the push mode, plus
+  the wake-ups of the thread rendering ahead.
 */
-AudioOut::~AudioOut()
+float AudioOut::wakeupsPerSecond()
+{
+    const qint64 elapsed(m_wakeupTimer.restart());
+    int count(m_wakeupCount.fetchAndStoreOrdered(0));
+
+    if (m_pullDevice)
+        count += m_pullDevice->takeReadCount();
+
+    if (elapsed <= 0)
+        return 0.0f;
+
+    return (float)count * 1000.0f / (float)elapsed;
+}
+
+
+/*!
+  Sets the lead time, i.e. how far ahead of the audio device the source is
+  rendered, to \a milliseconds. A longer lead time makes the output more
+  robust against stalls in the mixing at the cost of latency. The value is
+  bounded between 5 and 500 milliseconds and can be changed at any time.
+
+  In the manual tick mode (Symbian), the source is rendered in tick() by
+  default; setting a lead time starts a thread rendering ahead and setting 0
+  stops it. In the other modes the rendering is always done ahead.
+*/
+void AudioOut::setLeadTime(int milliseconds)
+{
+    if (milliseconds <= 0 && m_outputMode == PushMode && !m_usingThread) {
+        // Back to rendering directly in tick().
+        stopThread();
+        m_leadSamples = 0;
+        m_leadTime = 0;
+        m_ringBuffer->clear();
+        return;
+    }
+
+    m_leadTime = qBound(GEMinLeadTime, milliseconds, GEMaxLeadTime);
+    m_leadSamples = m_leadTime * AudioConfig::sampleRate() / 1000 *
+                    AudioConfig::channelCount();
+    DEBUG_INFO("Lead time set to " << m_leadTime << " ms.");
+
+    if (!QThread::isRunning())
+        startThread();
+}
+
+
+/*!
+  Returns the number of samples rendered ahead and waiting to be sent to the
+  audio device.
+*/
+int AudioOut::bufferedSamples() const
+{
+    return m_ringBuffer->count();
+}
+
+
+/*!
+  Returns the number of times the audio device has run out of the samples
+  rendered ahead.
+*/
+int AudioOut::underrunCount() const
+{
+    return m_ringBuffer->underrunCount();
+}
+
+
+/*!
+  Starts the thread running run().
+*/
+void AudioOut::startThread()
+{
+    if (!m_source || QThread::isRunning())
+        return;
+
+    // Set before starting to avoid racing with stopThread().
+    m_threadState = DoRun;
+    start();
+}
+
+
+/*!
+  Stops the thread running run() and waits until it has finished.
+*/
+void AudioOut::stopThread()
 {
     if (m_threadState == DoRun) {
         // Set the thread to exit run().
         m_threadState = DoExit;
     }
 
-    if (QThread::isRunning() == false) {
-        m_threadState = NotRunning;
-    }
+    wait();
+    m_threadState = NotRunning;
+}
 
-    while (m_threadState != NotRunning) {
-        // Wait until the thread is finished.
-        msleep(50);
-    }
 
-    m_audioOutput->stop();
+/*!
+  Renders the source into the ring until it holds the lead time worth of
+  samples.
+*/
+void AudioOut::renderAhead()
+{
+    const int missing(m_leadSamples - m_ringBuffer->count());
 
-    delete m_audioOutput;
-    delete [] m_sendBuffer;
+    if (missing > 0)
+        m_ringBuffer->fill(m_source, missing);
 }
 
 
@@ -155,6 +370,7 @@ void AudioOut::audioNotify()
   TODO: Document what this method actually does and why it is needed.
 
   Call this method manually only if you are not using a thread (with Symbian).
+  Does nothing in the pull mode.
 
   Note: When using Qt GameEnabler, the GameWindow instance owning this AudioOut
   instance will handle calling this method and you should not try to call this
@@ -162,9 +378,18 @@ void AudioOut::audioNotify()
 */
 void AudioOut::tick()
 {
+    if (m_outputMode == PullMode) {
+        // Nothing to do, the device pulls the data itself.
+        return;
+    }
+
+    GE_PROFILE_ZONE("AudioOut::tick");
+    m_wakeupCount.ref();
+
     // Fill data to the buffer as much as there is free space available.
     int samplesToWrite(m_audioOutput->bytesFree() /
-                       (GEDefaultChannelCount * AUDIO_SAMPLE_BITS / 8));
+                       (AudioConfig::channelCount() *
+                        AudioConfig::sampleSize() / 8));
     samplesToWrite *= 2;
 
     if (samplesToWrite <= 0)
@@ -173,7 +398,13 @@ void AudioOut::tick()
     if (samplesToWrite > m_sendBufferSize)
         samplesToWrite = m_sendBufferSize;
 
-    int mixedSamples = m_source->pullAudio(m_sendBuffer, samplesToWrite);
+    // Copy from the ring if rendering ahead, otherwise render now.
+    AudioSource *source = m_source;
+
+    if (m_leadSamples > 0)
+        source = m_ringBuffer;
+
+    int mixedSamples = source->pullAudio(m_sendBuffer, samplesToWrite);
     m_outTarget->write((char*)m_sendBuffer, mixedSamples * 2);
 }
 
@@ -181,12 +412,13 @@ void AudioOut::tick()
 /*!
   From QThread.
 
-  Used only in threaded solutions.
+  Renders the source ahead into the ring and, in the threaded push mode,
+  pushes the data to the audio device. Used only in threaded solutions.
 */
 void AudioOut::run()
 {
     DEBUG_INFO("Starting thread.");
-    m_threadState = DoRun;
+    GE_PROFILE_THREAD("Audio");
 
     if (!m_source) {
         DEBUG_INFO("No audio source, exiting the thread!");
@@ -195,8 +427,19 @@ void AudioOut::run()
     }
 
     while (m_threadState == DoRun) {
-        tick();
-        msleep(GEThreadSleepTime);
+        if (m_leadSamples > 0)
+            renderAhead();
+
+        if (m_usingThread) {
+            tick();
+            msleep(GEThreadSleepTime);
+        }
+        else {
+            // Only rendering ahead, no need to wake up more often than a
+            // few times per lead time.
+            m_wakeupCount.ref();
+            msleep(qMax(GEThreadSleepTime, m_leadTime / 4));
+        }
     }
 
     DEBUG_INFO("Exiting thread.");
@@ -7,6 +7,8 @@
 #ifndef GEAUDIOOUT_H
 #define GEAUDIOOUT_H
 
+#include <QAtomicInt>
+#include <QElapsedTimer>
 #include <QThread>
 #include "audiosourceif.h"
 
@@ -17,6 +19,11 @@ class QIODevice;
 
 namespace GE {
 
+// Forward declarations (inside GE namespace)
+class AudioPullDevice;
+class AudioRingBuffer;
+
+
 class AudioOut : public QThread
 {
     Q_OBJECT
@@ -29,12 +36,24 @@ public: // Data types
         DoExit = 2
     };
 
+    enum OutputMode {
+        PullMode = 0, // The audio device pulls the data when it needs it
+        PushMode = 1 // The data is pushed by a polling thread or tick()
+    };
+
 public:
     AudioOut(AudioSource *source, QObject *parent = 0);
+    AudioOut(AudioSource *source, OutputMode mode, QObject *parent = 0);
     virtual ~AudioOut();
 
 public:
     bool usingThead() const { return m_usingThread; }
+    inline OutputMode outputMode() const { return m_outputMode; }
+    float wakeupsPerSecond();
+    inline int leadTime() const { return m_leadTime; }
+    void setLeadTime(int milliseconds);
+    int bufferedSamples() const;
+    int underrunCount() const;
 
 public slots:
     void tick();
@@ -45,15 +64,29 @@ private slots:
 protected: // From QThread
      virtual void run(); // For the threaded mode only!
 
+protected:
+    void init(OutputMode mode);
+    void startPushMode();
+    void startThread();
+    void stopThread();
+    void renderAhead();
+
 protected: // Data
     QAudioOutput *m_audioOutput; // Owned
     QIODevice *m_outTarget; // Not owned
+    AudioPullDevice *m_pullDevice; // Owned
+    AudioRingBuffer *m_ringBuffer; // Owned
     AudioSource *m_source; // Not owned
     AUDIO_SAMPLE_TYPE *m_sendBuffer; // Owned
     int m_sendBufferSize;
     qint64 m_samplesMixed;
     int m_threadState;
     bool m_usingThread;
+    OutputMode m_outputMode;
+    QAtomicInt m_wakeupCount; // Push mode only
+    QElapsedTimer m_wakeupTimer;
+    QAtomicInt m_leadSamples; // 0 when not rendering ahead
+    int m_leadTime; // Milliseconds
 };
 
 } // namespace GE
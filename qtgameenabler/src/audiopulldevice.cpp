@@ -0,0 +1,122 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#include "audiopulldevice.h"
+#include <memory.h>
+#include "trace.h" // For debug macros
+
+using namespace GE;
+
+// Constants
+const int GEPullDeviceFrameSize(2 * sizeof(AUDIO_SAMPLE_TYPE)); // Stereo
+const qint64 GEPullDeviceBytesAvailable(4096 * 4);
+
+
+/*!
+  \class AudioPullDevice
+  \brief A read-only QIODevice rendering its data from an AudioSource on
+         demand. Given to QAudioOutput::start(QIODevice*) to let the audio
+         device pull the audio when it needs more, instead of polling it.
+*/
+
+
+/*!
+  Constructor. The device is opened for reading.
+*/
+AudioPullDevice::AudioPullDevice(AudioSource *source, QObject *parent /* = 0 */)
+    : QIODevice(parent),
+      m_source(source),
+      m_readCount(0)
+{
+    open(QIODevice::ReadOnly);
+}
+
+
+/*!
+  Destructor.
+*/
+AudioPullDevice::~AudioPullDevice()
+{
+    close();
+}
+
+
+/*!
+  Returns the number of readData() calls made since the previous call and
+  resets the count.
+*/
+int AudioPullDevice::takeReadCount()
+{
+    return m_readCount.fetchAndStoreOrdered(0);
+}
+
+
+/*!
+  From QIODevice.
+
+  The audio is generated on demand, so the device is sequential.
+*/
+bool AudioPullDevice::isSequential() const
+{
+    return true;
+}
+
+
+/*!
+  From QIODevice.
+
+  There is always data available since silence is generated when the source
+  does not produce anything.
+*/
+qint64 AudioPullDevice::bytesAvailable() const
+{
+    return GEPullDeviceBytesAvailable + QIODevice::bytesAvailable();
+}
+
+
+/*!
+  From QIODevice.
+
+  Pulls at most \a maxSize bytes of whole stereo frames from the source
+  directly into \a data. If the source produces less than requested, the
+  rest is filled with silence to keep the audio device running. Returns the
+  number of bytes written.
+*/
+qint64 AudioPullDevice::readData(char *data, qint64 maxSize)
+{
+    m_readCount.ref();
+
+    const int bytes((int)(maxSize - maxSize % GEPullDeviceFrameSize));
+
+    if (bytes <= 0)
+        return 0;
+
+    const int samples(bytes / sizeof(AUDIO_SAMPLE_TYPE));
+    AUDIO_SAMPLE_TYPE *target = (AUDIO_SAMPLE_TYPE*)data;
+    int mixed(0);
+
+    if (m_source)
+        mixed = qBound(0, m_source->pullAudio(target, samples), samples);
+
+    if (mixed < samples)
+        memset(target + mixed, 0,
+               sizeof(AUDIO_SAMPLE_TYPE) * (samples - mixed));
+
+    return bytes;
+}
+
+
+/*!
+  From QIODevice.
+
+  The device is read-only, always returns -1.
+*/
+qint64 AudioPullDevice::writeData(const char *data, qint64 maxSize)
+{
+    Q_UNUSED(data);
+    Q_UNUSED(maxSize);
+    return -1;
+}
@@ -0,0 +1,43 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#ifndef GEAUDIOPULLDEVICE_H
+#define GEAUDIOPULLDEVICE_H
+
+#include <QAtomicInt>
+#include <QIODevice>
+#include "audiosourceif.h"
+
+
+namespace GE {
+
+class AudioPullDevice : public QIODevice
+{
+    Q_OBJECT
+
+public:
+    explicit AudioPullDevice(AudioSource *source, QObject *parent = 0);
+    virtual ~AudioPullDevice();
+
+public:
+    int takeReadCount();
+
+public: // From QIODevice
+    bool isSequential() const;
+    qint64 bytesAvailable() const;
+
+protected: // From QIODevice
+    qint64 readData(char *data, qint64 maxSize);
+    qint64 writeData(const char *data, qint64 maxSize);
+
+protected: // Data
+    AudioSource *m_source; // Not owned
+    QAtomicInt m_readCount;
+};
+
+} // namespace GE
+
+#endif // GEAUDIOPULLDEVICE_H
@@ -0,0 +1,178 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#include "audioringbuffer.h"
+#include <memory.h>
+#include "audiokernels.h"
+#include "trace.h" // For debug macros
+
+using namespace GE;
+
+
+/*!
+  \class AudioRingBuffer
+  \brief A lock-free single-producer/single-consumer ring of interleaved
+         stereo samples.
+
+  The producer thread renders audio into the ring ahead of time with fill()
+  and the consumer (the audio device) copies it out with pullAudio(). Neither
+  side ever blocks or allocates memory, so a stall in the mixing is absorbed
+  by the audio buffered in the ring instead of causing an underrun.
+*/
+
+
+/*!
+  Constructor. The capacity is \a minimumCapacity samples rounded up to the
+  next power of two.
+*/
+AudioRingBuffer::AudioRingBuffer(int minimumCapacity, QObject *parent /* = 0 */)
+    : AudioSource(parent),
+      m_data(0),
+      m_capacity(2),
+      m_head(0),
+      m_tail(0),
+      m_underrunCount(0)
+{
+    while (m_capacity < minimumCapacity)
+        m_capacity <<= 1;
+
+    m_data = (AUDIO_SAMPLE_TYPE*)AudioKernels::allocateBuffer(
+        sizeof(AUDIO_SAMPLE_TYPE) * m_capacity);
+    memset(m_data, 0, sizeof(AUDIO_SAMPLE_TYPE) * m_capacity);
+}
+
+
+/*!
+  Destructor.
+*/
+AudioRingBuffer::~AudioRingBuffer()
+{
+    AudioKernels::freeBuffer(m_data);
+}
+
+
+/*!
+  Returns the number of samples buffered. Exact when called from the
+  producer or the consumer thread, otherwise an estimate.
+*/
+int AudioRingBuffer::count() const
+{
+    return (int)((unsigned int)(int)m_tail - (unsigned int)(int)m_head);
+}
+
+
+/*!
+  Returns the number of times pullAudio() has run out of buffered samples.
+*/
+int AudioRingBuffer::underrunCount() const
+{
+    return m_underrunCount;
+}
+
+
+/*!
+  Drops all the buffered samples. Must not be called while the producer or
+  the consumer is running.
+*/
+void AudioRingBuffer::clear()
+{
+    m_head = 0;
+    m_tail = 0;
+}
+
+
+/*!
+  Producer side. Renders \a samples samples (rounded down to whole stereo
+  frames) from \a source into the free space of the ring. If the source
+  produces less than requested and \a padWithSilence is true, the rest is
+  filled with silence so that the stream stays continuous; otherwise the
+  filling stops there. Returns the number of samples written.
+*/
+int AudioRingBuffer::fill(AudioSource *source,
+                          int samples,
+                          bool padWithSilence /* = true */)
+{
+    const unsigned int head(m_head.fetchAndAddAcquire(0));
+    unsigned int tail((int)m_tail);
+    const int space(m_capacity - (int)(tail - head));
+
+    samples = qMin(samples, space) & ~1;
+
+    int written(0);
+
+    while (written < samples) {
+        // Render into the contiguous part up to the end of the ring.
+        const int index((int)(tail & (m_capacity - 1)));
+        const int length(qMin(samples - written, m_capacity - index));
+        AUDIO_SAMPLE_TYPE *target = m_data + index;
+        int mixed(0);
+
+        if (source)
+            mixed = qBound(0, source->pullAudio(target, length), length);
+
+        if (mixed < length && !padWithSilence) {
+            // The source has ended.
+            tail += mixed & ~1;
+            written += mixed & ~1;
+            m_tail.fetchAndStoreRelease((int)tail);
+            break;
+        }
+
+        if (mixed < length)
+            memset(target + mixed, 0,
+                   sizeof(AUDIO_SAMPLE_TYPE) * (length - mixed));
+
+        tail += length;
+        written += length;
+        m_tail.fetchAndStoreRelease((int)tail);
+    }
+
+    return written;
+}
+
+
+/*!
+  Consumer side. Copies at most \a length samples from the ring into
+  \a target. Returns the number of samples copied.
+*/
+int AudioRingBuffer::read(AUDIO_SAMPLE_TYPE *target, int length)
+{
+    const unsigned int tail(m_tail.fetchAndAddAcquire(0));
+    const unsigned int head((int)m_head);
+    const int available((int)(tail - head));
+    const int count(qMin(length, available));
+    const int index((int)(head & (m_capacity - 1)));
+    const int firstPart(qMin(count, m_capacity - index));
+
+    memcpy(target, m_data + index, sizeof(AUDIO_SAMPLE_TYPE) * firstPart);
+    memcpy(target + firstPart, m_data,
+           sizeof(AUDIO_SAMPLE_TYPE) * (count - firstPart));
+
+    m_head.fetchAndStoreRelease((int)(head + count));
+    return count;
+}
+
+
+/*!
+  From AudioSource.
+
+  Consumer side. Copies \a bufferLength samples from the ring into \a target.
+  If the ring runs empty, the rest is filled with silence and the underrun is
+  counted. Always returns \a bufferLength.
+*/
+int AudioRingBuffer::pullAudio(AUDIO_SAMPLE_TYPE *target, int bufferLength)
+{
+    const int length(read(target, bufferLength));
+
+    if (length < bufferLength) {
+        memset(target + length, 0,
+               sizeof(AUDIO_SAMPLE_TYPE) * (bufferLength - length));
+        m_underrunCount.ref();
+        DEBUG_INFO("Underrun, missing" << bufferLength - length << "samples.");
+    }
+
+    return bufferLength;
+}
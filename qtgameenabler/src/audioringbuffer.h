@@ -0,0 +1,46 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#ifndef GEAUDIORINGBUFFER_H
+#define GEAUDIORINGBUFFER_H
+
+#include <QAtomicInt>
+#include "audiosourceif.h"
+
+
+namespace GE {
+
+class AudioRingBuffer : public AudioSource
+{
+    Q_OBJECT
+
+public:
+    explicit AudioRingBuffer(int minimumCapacity, QObject *parent = 0);
+    virtual ~AudioRingBuffer();
+
+public:
+    inline int capacity() const { return m_capacity; }
+    int count() const;
+    int underrunCount() const;
+    void clear();
+
+    int fill(AudioSource *source, int samples, bool padWithSilence = true);
+    int read(AUDIO_SAMPLE_TYPE *target, int length);
+
+public: // From AudioSource
+    int pullAudio(AUDIO_SAMPLE_TYPE *target, int bufferLength);
+
+protected: // Data
+    AUDIO_SAMPLE_TYPE *m_data; // Owned
+    int m_capacity; // In samples, a power of two
+    QAtomicInt m_head; // Read position, written by the consumer only
+    QAtomicInt m_tail; // Write position, written by the producer only
+    QAtomicInt m_underrunCount;
+};
+
+} // namespace GE
+
+#endif // GEAUDIORINGBUFFER_H
@@ -19,7 +19,8 @@ using namespace GE;
   Constructor.
 */
 AudioSource::AudioSource(QObject *parent /* = 0 */)
-    : QObject(parent)
+    : QObject(parent),
+      m_priority(0)
 {
 }
 
@@ -43,3 +44,32 @@ bool AudioSource::canBeDestroyed()
 {
     return false;
 }
+
+
+/*!
+  Returns an estimate of the loudest output volume of this source in the
+  fixed-point scale of GEMaxAudioVolumeValue. AudioMixer uses the value to
+  decide which sources are mixed when the number of real voices is limited.
+  A source returning 0 is never mixed, only skipped.
+
+  The default implementation returns GEMaxAudioVolumeValue.
+*/
+int AudioSource::audibleVolume() const
+{
+    return (int)GEMaxAudioVolumeValue;
+}
+
+
+/*!
+  Advances the source by \a bufferLength samples without producing any
+  output. Called by AudioMixer instead of pullAudio() while the source is a
+  virtual voice.
+
+  The default implementation pulls the audio into \a scratch and discards it.
+  Derived classes should override this method with a cheaper one, for
+  example by advancing the play position only.
+*/
+void AudioSource::skipAudio(AUDIO_SAMPLE_TYPE *scratch, int bufferLength)
+{
+    pullAudio(scratch, bufferLength);
+}
@@ -12,7 +12,7 @@
 
 namespace GE {
 
-#define AUDIO_FREQUENCY 22050
+#define AUDIO_FREQUENCY 22050 // Fallback only, see AudioConfig::sampleRate()
 #define AUDIO_SAMPLE_TYPE short
 #define AUDIO_SAMPLE_BITS 16
 
@@ -29,8 +29,16 @@ public:
     virtual ~AudioSource();
 
 public:
+    inline int priority() const { return m_priority; }
+    inline void setPriority(int priority) { m_priority = priority; }
+
     virtual bool canBeDestroyed();
+    virtual int audibleVolume() const;
     virtual int pullAudio(AUDIO_SAMPLE_TYPE *target, int bufferLength ) = 0;
+    virtual void skipAudio(AUDIO_SAMPLE_TYPE *scratch, int bufferLength);
+
+protected: // Data
+    int m_priority;
 };
 
 } // namespace GE
@@ -0,0 +1,992 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#include "audiovoice.h"
+#include "audioadpcm.h"
+#include "audiobuffer.h"
+#include "audioconfig.h"
+#include "audiointerpolation.h"
+#include "audiokernels.h"
+#include <memory.h>
+#include "trace.h"
+
+using namespace GE;
+
+// Constants
+const float GEDefaultAudioVolume(1.0f); // 1.0 => 100 %
+const float GEDefaultAudioSpeed(1.0f); // 1.0 => 100 %
+const int GEFixedPosBits(32); // The fractional bits of the play position
+const qint64 GEUnityFixedInc(Q_INT64_C(1) << GEFixedPosBits);
+const qint64 GEFixedFractionMask(GEUnityFixedInc - 1);
+
+// The interpolation uses the 12 topmost bits of the fraction.
+const int GEInterpolationShift(GEFixedPosBits - 12);
+
+
+/*!
+  Sample readers used by the mixing kernels. Each reader returns the sample
+  at the given index of the raw interleaved data, converted to the range of
+  AUDIO_SAMPLE_TYPE. The conversions match the AudioBuffer::sampleFunction*
+  reference implementations.
+*/
+namespace {
+
+struct Sample8bitReader {
+    explicit Sample8bitReader(const void *data)
+        : m_data((const quint8*)data) {}
+
+    inline int operator()(int index) const {
+        return (AUDIO_SAMPLE_TYPE)((m_data[index] - 128) << 8);
+    }
+
+    const quint8 *m_data;
+};
+
+struct Sample16bitReader {
+    explicit Sample16bitReader(const void *data)
+        : m_data((const quint16*)data) {}
+
+    inline int operator()(int index) const {
+        return (AUDIO_SAMPLE_TYPE)(m_data[index]);
+    }
+
+    const quint16 *m_data;
+};
+
+struct Sample32bitReader {
+    explicit Sample32bitReader(const void *data)
+        : m_data((const float*)data) {}
+
+    inline int operator()(int index) const {
+        return (AUDIO_SAMPLE_TYPE)(m_data[index] * 65536.0f / 2.0f);
+    }
+
+    const float *m_data;
+};
+
+
+/*!
+  Returns the bits of \a value as an integer, for storing it atomically.
+*/
+inline int floatToBits(float value)
+{
+    int bits(0);
+    memcpy(&bits, &value, sizeof(int));
+    return bits;
+}
+
+
+/*!
+  Returns the float with the \a bits stored by floatToBits().
+*/
+inline float bitsToFloat(int bits)
+{
+    float value(0.0f);
+    memcpy(&value, &bits, sizeof(float));
+    return value;
+}
+
+} // namespace
+
+
+/*!
+  \class AudioVoice
+  \brief The playback state of a single audio buffer: position, speed,
+         volume and looping. Mixes the buffer into the target on request.
+
+  Unlike AudioBufferPlayInstance, AudioVoice is not a QObject and does not
+  allocate any memory, which makes it cheap to construct and to reuse. The
+  exception are compressed buffers: two decoded blocks of them are cached.
+  The cache is allocated by play() for the largest blocks supported, see
+  GEMaxAdpcmBlockAlign, and kept until the voice is destroyed.
+*/
+
+
+/*!
+  Constructor. If \a buffer is not NULL, it is set as the buffer to play.
+*/
+AudioVoice::AudioVoice(AudioBuffer *buffer /* = 0 */)
+    : m_buffer(0),
+      m_copyFunction(0),
+      m_finished(false),
+      m_fixedPos(0),
+      m_fixedInc(0),
+      m_fixedIncReciprocal(0.0),
+      m_sampleRate(0),
+      m_speed(GEDefaultAudioSpeed),
+      m_pendingSpeed(floatToBits(GEDefaultAudioSpeed)),
+      m_pendingRestart(0),
+      m_fixedLeftVolume((int)GEMaxAudioVolumeValue),
+      m_fixedRightVolume((int)GEMaxAudioVolumeValue),
+      m_loopCount(0),
+      m_interpolationMode(LinearInterpolation),
+      m_blockCache(0),
+      m_blockCacheLength(0),
+      m_cachedBlock(-1)
+{
+    for (int i = 0; i < InterpolationModeCount; i++)
+        m_mixFunctions[i] = 0;
+
+    if (buffer) {
+        // Start playing the given buffer.
+        play(buffer, GEDefaultAudioVolume, GEDefaultAudioSpeed);
+    }
+}
+
+
+/*!
+  Destructor. Releases the buffer being played.
+*/
+AudioVoice::~AudioVoice()
+{
+    if (m_buffer)
+        m_buffer->release();
+
+    if (m_blockCache)
+        AudioKernels::freeBuffer(m_blockCache);
+}
+
+
+/*!
+  Returns true if the buffer is set, false otherwise.
+*/
+bool AudioVoice::isPlaying() const
+{
+    if (m_buffer)
+        return true;
+
+    return false;
+}
+
+
+/*!
+  Returns the louder of the channel volumes or 0 if nothing is playing.
+*/
+int AudioVoice::audibleVolume() const
+{
+    if (!m_buffer)
+        return 0;
+
+    return qMax(m_fixedLeftVolume, m_fixedRightVolume);
+}
+
+
+/*!
+  Renders the next \a bufferLength samples (interleaved stereo) of the buffer
+  into \a target. Returns the number of samples written.
+*/
+int AudioVoice::pullAudio(AUDIO_SAMPLE_TYPE *target, int bufferLength)
+{
+    if (!m_buffer) {
+        // No sample!
+        return 0;
+    }
+
+    const int channelLength(m_buffer->getFrameCount() - 2);
+
+    if (channelLength <= 0) {
+        // Nothing to mix, would loop forever.
+        stop();
+        return 0;
+    }
+
+    int samplesToWrite(bufferLength / 2);
+    int amount(0);
+    int totalMixed(0);
+
+    applyPendingChanges();
+
+    const qint64 fixedEnd((qint64)channelLength << GEFixedPosBits);
+
+    while (samplesToWrite > 0) {
+        // This is how much we can mix before the end of the buffer.
+        const int maxMixAmount(samplesBefore(fixedEnd, samplesToWrite));
+
+        if (maxMixAmount > 0) {
+            amount = mixBlock(target+totalMixed * 2, maxMixAmount);
+
+            if (amount == 0) {
+                // Error!
+                break;
+            }
+
+            totalMixed += amount;
+        }
+        else {
+            amount = 0;
+        }
+
+        // The sample ended. Check the looping variables and see what to do.
+        // The fraction past the end is kept so that the loop stays sample
+        // accurate.
+        if (m_fixedPos >= fixedEnd) {
+            m_fixedPos -= fixedEnd;
+
+            if (m_loopCount > 0)
+                m_loopCount--;
+
+            if (m_loopCount == 0) {
+                // No more loops, stop the sample and return the amount of
+                // samples already mixed.
+                stop();
+                return totalMixed * 2;
+            }
+        }
+
+        samplesToWrite -= amount;
+
+        if (samplesToWrite < 1)
+            break;
+    }
+
+    return totalMixed * 2;
+}
+
+
+/*!
+  Advances the play position by \a bufferLength samples (interleaved stereo)
+  without mixing anything, taking the looping into account. Used while the
+  voice is virtual. Returns the number of samples skipped.
+*/
+int AudioVoice::skipAudio(int bufferLength)
+{
+    if (!m_buffer)
+        return 0;
+
+    const int channelLength(m_buffer->getFrameCount() - 2);
+
+    if (channelLength <= 0) {
+        stop();
+        return 0;
+    }
+
+    applyPendingChanges();
+
+    const qint64 end((qint64)channelLength << GEFixedPosBits);
+    qint64 pos(m_fixedPos + m_fixedInc * (bufferLength / 2));
+
+    if (pos >= end) {
+        // Every wrap consumes one loop, see pullAudio().
+        const qint64 wraps(pos / end);
+
+        if (m_loopCount >= 0 && wraps >= qMax(m_loopCount, 1)) {
+            stop();
+            return bufferLength;
+        }
+
+        if (m_loopCount > 0)
+            m_loopCount -= (int)wraps;
+
+        pos %= end;
+    }
+
+    m_fixedPos = pos;
+    return bufferLength;
+}
+
+
+/*!
+  Applies the changes made from other threads, called by the mixing thread
+  before each block. A restart requested by play() rewinds the position,
+  and the increment is recomputed when the speed set with setSpeed(), the
+  buffer or the mixing rate has changed. The 64-bit position and increment
+  are written only here and while mixing, so they are never torn on the
+  32-bit targets.
+*/
+void AudioVoice::applyPendingChanges()
+{
+    if (m_pendingRestart.testAndSetAcquire(1, 0)) {
+        m_fixedPos = 0;
+        m_fixedInc = 0; // The rate of the buffer may differ
+        m_cachedBlock = -1;
+    }
+
+    const float speed(bitsToFloat(m_pendingSpeed.fetchAndAddAcquire(0)));
+    const int sampleRate(AudioConfig::sampleRate());
+
+    if (m_fixedInc > 0 && speed == m_speed && sampleRate == m_sampleRate)
+        return;
+
+    // The increment at the normal speed.
+    const double unityInc((double)m_buffer->getSamplesPerSec() *
+                          (double)GEUnityFixedInc / (double)sampleRate);
+
+    m_speed = speed;
+    m_sampleRate = sampleRate;
+    m_fixedInc = (qint64)(unityInc * speed);
+
+    if (m_fixedInc <= 0) {
+        // Would lead to a division by zero, use the default speed.
+        m_fixedInc = (qint64)(unityInc * GEDefaultAudioSpeed);
+    }
+
+    m_fixedIncReciprocal = (m_fixedInc > 0) ? 1.0 / (double)m_fixedInc : 0.0;
+}
+
+
+/*!
+  Returns the number of stereo samples, at most \a maxSamples, which can be
+  mixed from the current position before reaching \a fixedEnd. Uses the
+  precomputed reciprocal of the increment instead of a 64-bit division; the
+  estimate is corrected to the exact value with multiplications only.
+*/
+int AudioVoice::samplesBefore(qint64 fixedEnd, int maxSamples) const
+{
+    const qint64 left(fixedEnd - m_fixedPos);
+
+    if (left <= 0)
+        return 0;
+
+    // The samples starting before the end can be mixed, i.e. the ceiling of
+    // left / m_fixedInc.
+    const double estimate((double)left * m_fixedIncReciprocal);
+
+    if (estimate >= (double)maxSamples + 1.0)
+        return maxSamples;
+
+    qint64 samples((qint64)estimate);
+
+    while (samples * m_fixedInc < left)
+        samples++;
+
+    while (samples > 1 && (samples - 1) * m_fixedInc >= left)
+        samples--;
+
+    return (int)qMin(samples, (qint64)maxSamples);
+}
+
+
+/*!
+  Sets \a buffer as the audio buffer and will repeat the buffer according to
+  \a loopCount. Note: If the given loop count is -1, the buffer will be
+  repeated forever. The buffer is marked to be in use until the voice stops,
+  see AudioBuffer::acquire().
+*/
+void AudioVoice::play(AudioBuffer *buffer, int loopCount /* = 0 */)
+{
+    if (buffer)
+        buffer->acquire();
+
+    if (m_buffer)
+        m_buffer->release();
+
+    m_buffer = buffer;
+    m_finished = false;
+    m_loopCount = loopCount;
+
+    // The mixing thread rewinds the voice, see applyPendingChanges().
+    m_pendingRestart.fetchAndStoreRelease(1);
+
+    if (m_buffer && m_buffer->isCompressed() && !m_blockCache) {
+        // Room for two stereo blocks of the largest size, the interpolation
+        // reads across the boundary. Never reallocated, the audio thread may
+        // still be decoding the previous buffer into the cache.
+        const int length(2 * AudioAdpcm::samplesPerBlock(
+            GEMaxAdpcmBlockAlign * 2, 2) * 2);
+
+        m_blockCache = (AUDIO_SAMPLE_TYPE*)AudioKernels::allocateBuffer(
+            length * sizeof(AUDIO_SAMPLE_TYPE));
+        m_blockCacheLength = length;
+    }
+
+    if (m_buffer && !setMixFunction()) {
+        DEBUG_INFO("Unsupported buffer format, the buffer will not be mixed!");
+    }
+}
+
+
+/*!
+  For convenience.
+
+  In addition to play(AudioBuffer*, int) method, will also set \a volume
+  and \a speed.
+*/
+void AudioVoice::play(AudioBuffer *buffer,
+                      float volume,
+                      float speed,
+                      int loopCount /* = 0 */)
+{
+    play(buffer, loopCount);
+    setLeftVolume(volume);
+    m_fixedRightVolume = m_fixedLeftVolume;
+
+    // The speed depends on the sample rate of the buffer and must be set
+    // after the buffer.
+    setSpeed(speed);
+}
+
+
+/*!
+  Resets the local buffer i.e. gets rid of the set buffer.
+*/
+void AudioVoice::stop()
+{
+    if (m_buffer)
+        m_buffer->release();
+
+    m_buffer = 0;
+    m_finished = true;
+}
+
+
+/*!
+  Sets the loop count to \a count. If the argument value is -1, the
+  buffer is looped forever.
+*/
+void AudioVoice::setLoopCount(int count)
+{
+    DEBUG_INFO("Setting the loop count to " << count);
+    m_loopCount = count;
+}
+
+
+/*!
+  Sets \a speed as the speed of which the buffer is played in. The given
+  argument value should be between 0.0 and 1.0 since 1.0 indicates 100 %.
+  Can be called from any thread, the speed is applied by the mixing thread
+  at the start of the next block.
+*/
+void AudioVoice::setSpeed(float speed)
+{
+    m_pendingSpeed.fetchAndStoreRelease(floatToBits(speed));
+}
+
+
+/*!
+  Sets \a volume for the left channel. The given argument value should be
+  between 0.0 and 1.0 since 1.0 indicates 100 %.
+*/
+void AudioVoice::setLeftVolume(float volume)
+{
+    m_fixedLeftVolume = (int)(GEMaxAudioVolumeValue * volume);
+}
+
+
+/*!
+  Sets \a volume for the right channel. The given argument value should be
+  between 0.0 and 1.0 since 1.0 indicates 100 %.
+*/
+void AudioVoice::setRightVolume(float volume)
+{
+    m_fixedRightVolume = (int)(GEMaxAudioVolumeValue * volume);
+}
+
+
+/*!
+  Sets the interpolation used when the buffer is resampled to \a mode.
+  LinearInterpolation is the cheapest but aliases audibly when the pitch is
+  shifted. CubicInterpolation is smoother, and SincInterpolation also
+  filters out the frequencies which would alias when the buffer is played
+  faster than its own rate. See AudioInterpolation::measureCosts() for the
+  cost of each mode. Can be changed while playing.
+*/
+void AudioVoice::setInterpolationMode(InterpolationMode mode)
+{
+    if (mode < LinearInterpolation || mode >= InterpolationModeCount)
+        mode = LinearInterpolation;
+
+    m_interpolationMode = mode;
+}
+
+
+/*!
+  Mixes \a samplesToMix stereo samples of the current buffer into \a target
+  using the mixing kernel selected for the buffer format. If the library is
+  built with GE_AUDIO_REFERENCE_MIXING defined, the generic (and slow)
+  reference implementation is used instead.
+
+  When a buffer in the mixing format (see AudioBuffer::convertToMixFormat())
+  is played at the normal speed from a whole sample position, no conversion
+  nor interpolation is needed and the samples are just copied with gain.
+
+  The reference implementation always interpolates linearly.
+
+  Returns the number of samples mixed or 0 in case of an error.
+
+  Note: Does not do any bound checking, must be checked before called!
+*/
+int AudioVoice::mixBlock(AUDIO_SAMPLE_TYPE *target, int samplesToMix)
+{
+#ifdef GE_AUDIO_REFERENCE_MIXING
+    return mixBlockReference(target, samplesToMix);
+#else
+    // The mode is read once, it may be changed from another thread.
+    const MIX_FUNCTION_TYPE mixFunction(m_mixFunctions[m_interpolationMode]);
+
+    if (!mixFunction) {
+        // Unsupported sample type.
+        return 0;
+    }
+
+    if (m_copyFunction && m_fixedInc == GEUnityFixedInc &&
+        (m_fixedPos & GEFixedFractionMask) == 0) {
+        return (m_copyFunction)(this, target, samplesToMix);
+    }
+
+    return (mixFunction)(this, target, samplesToMix);
+#endif
+}
+
+
+/*!
+  Selects the mixing kernels matching the sample format and the channel
+  count of the current buffer. The selection is done once per play() call
+  so that the per-sample work can be fully inlined by the compiler.
+
+  Returns true if successful, false otherwise.
+*/
+bool AudioVoice::setMixFunction()
+{
+    for (int i = 0; i < InterpolationModeCount; i++)
+        m_mixFunctions[i] = 0;
+
+    m_copyFunction = 0;
+
+    if (!m_buffer)
+        return false;
+
+    if (m_buffer->isCompressed()) {
+        // The filtered modes fall back to the linear interpolation.
+        MIX_FUNCTION_TYPE mixFunction(0);
+        const int channels(m_buffer->getNofChannels());
+
+        // The two blocks must fit in the cache.
+        if (2 * m_buffer->getSamplesPerBlock() * channels <=
+            m_blockCacheLength) {
+            if (channels == 2)
+                mixFunction = mixBlockAdpcm<2>;
+            else if (channels == 1)
+                mixFunction = mixBlockAdpcm<1>;
+        }
+
+        for (int i = 0; i < InterpolationModeCount; i++)
+            m_mixFunctions[i] = mixFunction;
+    }
+    else if (m_buffer->getNofChannels() == 2) {
+        if (m_buffer->getBitsPerSample() == 8)
+            selectMixFunctions<Sample8bitReader, 2>();
+
+        if (m_buffer->getBitsPerSample() == 16) {
+            selectMixFunctions<Sample16bitReader, 2>();
+            m_copyFunction = copyBlockStereo;
+        }
+
+        if (m_buffer->getBitsPerSample() == 32)
+            selectMixFunctions<Sample32bitReader, 2>();
+    }
+    else {
+        if (m_buffer->getBitsPerSample() == 8)
+            selectMixFunctions<Sample8bitReader, 1>();
+
+        if (m_buffer->getBitsPerSample() == 16)
+            selectMixFunctions<Sample16bitReader, 1>();
+
+        if (m_buffer->getBitsPerSample() == 32)
+            selectMixFunctions<Sample32bitReader, 1>();
+    }
+
+    return (m_mixFunctions[LinearInterpolation] != 0);
+}
+
+
+/*!
+  Sets the mixing kernels of all the interpolation modes for the sample
+  format \a Reader and the channel count \a Channels.
+*/
+template <class Reader, int Channels>
+void AudioVoice::selectMixFunctions()
+{
+    m_mixFunctions[LinearInterpolation] = mixBlockKernel<Reader, Channels>;
+    m_mixFunctions[CubicInterpolation] =
+        mixBlockFiltered<Reader, Channels, GECubicTaps>;
+    m_mixFunctions[SincInterpolation] =
+        mixBlockFiltered<Reader, Channels, GESincTaps>;
+}
+
+
+/*!
+  Mixing kernel specialized for the sample format (\a Reader) and the
+  channel count (\a Channels) of the source buffer. Produces the same output
+  as mixBlockReference() but without any per-sample function calls.
+
+  Note: Does not do any bound checking, must be checked before called!
+*/
+template <class Reader, int Channels>
+int AudioVoice::mixBlockKernel(AudioVoice *voice,
+                               AUDIO_SAMPLE_TYPE *target,
+                               int samplesToMix)
+{
+    const Reader reader(voice->m_buffer->getRawData());
+    const int leftVolume(voice->m_fixedLeftVolume);
+    const int rightVolume(voice->m_fixedRightVolume);
+    const qint64 fixedInc(voice->m_fixedInc);
+    qint64 fixedPos(voice->m_fixedPos);
+
+    AUDIO_SAMPLE_TYPE *t_target = target + samplesToMix * 2;
+    int sourcepos(0);
+    int frac(0);
+
+    if (Channels == 2) {
+        // Stereo
+        while (target != t_target) {
+            sourcepos = (int)(fixedPos >> GEFixedPosBits) * 2;
+            frac = (int)(fixedPos >> GEInterpolationShift) & 4095;
+
+            target[0] = ((((reader(sourcepos) * (4096 - frac) +
+                            reader(sourcepos + 2) * frac) >> 12) *
+                          leftVolume) >> 12);
+
+            target[1] = ((((reader(sourcepos + 1) * (4096 - frac) +
+                            reader(sourcepos + 3) * frac) >> 12) *
+                          rightVolume) >> 12);
+
+            fixedPos += fixedInc;
+            target += 2;
+        }
+    }
+    else {
+        // Mono
+        int temp(0);
+
+        while (target != t_target) {
+            sourcepos = (int)(fixedPos >> GEFixedPosBits);
+            frac = (int)(fixedPos >> GEInterpolationShift) & 4095;
+
+            temp = ((reader(sourcepos) * (4096 - frac) +
+                     reader(sourcepos + 1) * frac) >> 12);
+
+            target[0] = ((temp * leftVolume) >> 12);
+            target[1] = ((temp * rightVolume) >> 12);
+
+            fixedPos += fixedInc;
+            target += 2;
+        }
+    }
+
+    voice->m_fixedPos = fixedPos;
+    return samplesToMix;
+}
+
+
+/*!
+  Mixing kernel interpolating with a \a Taps long filter, see
+  setInterpolationMode(). Near the ends of the buffer the taps falling
+  outside of the data repeat the first or the last frame; elsewhere the
+  unchecked filterBlock() is used.
+
+  Note: Does not do any bound checking, must be checked before called!
+*/
+template <class Reader, int Channels, int Taps>
+int AudioVoice::mixBlockFiltered(AudioVoice *voice,
+                                 AUDIO_SAMPLE_TYPE *target,
+                                 int samplesToMix)
+{
+    const int frames(voice->m_buffer->getFrameCount());
+    const qint64 safeBegin((qint64)(Taps / 2 - 1) << GEFixedPosBits);
+    const qint64 safeEnd((qint64)(frames - Taps / 2) << GEFixedPosBits);
+    int mixed(0);
+    int amount(0);
+
+    while (mixed < samplesToMix) {
+        const int samplesLeft(samplesToMix - mixed);
+
+        if (voice->m_fixedPos >= safeBegin && voice->m_fixedPos < safeEnd) {
+            amount = voice->samplesBefore(safeEnd, samplesLeft);
+            filterBlock<Reader, Channels, Taps, false>(
+                voice, target + mixed * 2, amount, frames - 1);
+        }
+        else {
+            amount = (voice->m_fixedPos < safeBegin) ?
+                voice->samplesBefore(safeBegin, samplesLeft) : samplesLeft;
+            filterBlock<Reader, Channels, Taps, true>(
+                voice, target + mixed * 2, amount, frames - 1);
+        }
+
+        mixed += amount;
+    }
+
+    return samplesToMix;
+}
+
+
+/*!
+  Mixes \a samplesToMix stereo samples with the \a Taps long filter. The
+  coefficients are selected by the top bits of the fractional position. If
+  \a Clamp is true, the frame indices are limited to [0, \a lastFrame].
+
+  Note: Does not do any bound checking, must be checked before called!
+*/
+template <class Reader, int Channels, int Taps, bool Clamp>
+void AudioVoice::filterBlock(AudioVoice *voice,
+                             AUDIO_SAMPLE_TYPE *target,
+                             int samplesToMix,
+                             int lastFrame)
+{
+    const Reader reader(voice->m_buffer->getRawData());
+    const qint16 *table = (Taps == GECubicTaps) ?
+        AudioInterpolation::cubicTable() :
+        AudioInterpolation::sincTable(voice->m_fixedInc);
+    const int leftVolume(voice->m_fixedLeftVolume);
+    const int rightVolume(voice->m_fixedRightVolume);
+    const qint64 fixedInc(voice->m_fixedInc);
+    qint64 fixedPos(voice->m_fixedPos);
+
+    AUDIO_SAMPLE_TYPE *t_target = target + samplesToMix * 2;
+
+    while (target != t_target) {
+        const int firstFrame((int)(fixedPos >> GEFixedPosBits) - Taps / 2 + 1);
+        const qint16 *coefficients = table + Taps *
+            ((int)(fixedPos >> (GEFixedPosBits - GEInterpolationPhaseBits)) &
+             (GEInterpolationPhases - 1));
+        int left(0);
+        int right(0);
+
+        for (int i = 0; i < Taps; i++) {
+            int frame(firstFrame + i);
+
+            if (Clamp)
+                frame = qBound(0, frame, lastFrame);
+
+            left += reader(frame * Channels) * coefficients[i];
+
+            if (Channels == 2)
+                right += reader(frame * Channels + 1) * coefficients[i];
+        }
+
+        // The filters may overshoot, saturate the result.
+        left = qBound(-32768, left >> GEInterpolationCoefficientBits, 32767);
+
+        if (Channels == 2) {
+            right = qBound(-32768, right >> GEInterpolationCoefficientBits,
+                           32767);
+        }
+        else {
+            right = left;
+        }
+
+        target[0] = ((left * leftVolume) >> 12);
+        target[1] = ((right * rightVolume) >> 12);
+
+        fixedPos += fixedInc;
+        target += 2;
+    }
+
+    voice->m_fixedPos = fixedPos;
+}
+
+
+/*!
+  Copies \a samplesToMix stereo samples of a buffer in the mixing format
+  into \a target, applying the channel volumes. Used at the normal speed
+  from a whole sample position, where the output equals the one of
+  mixBlockKernel().
+
+  Note: Does not do any bound checking, must be checked before called!
+*/
+int AudioVoice::copyBlockStereo(AudioVoice *voice,
+                                AUDIO_SAMPLE_TYPE *target,
+                                int samplesToMix)
+{
+    const AUDIO_SAMPLE_TYPE *source =
+        (const AUDIO_SAMPLE_TYPE*)voice->m_buffer->getRawData() +
+        (int)(voice->m_fixedPos >> GEFixedPosBits) * 2;
+    const int leftVolume(voice->m_fixedLeftVolume);
+    const int rightVolume(voice->m_fixedRightVolume);
+
+    if (leftVolume == (int)GEMaxAudioVolumeValue &&
+        rightVolume == (int)GEMaxAudioVolumeValue) {
+        memcpy(target, source, samplesToMix * 2 * sizeof(AUDIO_SAMPLE_TYPE));
+    }
+    else {
+        AUDIO_SAMPLE_TYPE *t_target = target + samplesToMix * 2;
+
+        while (target != t_target) {
+            target[0] = ((source[0] * leftVolume) >> 12);
+            target[1] = ((source[1] * rightVolume) >> 12);
+            source += 2;
+            target += 2;
+        }
+    }
+
+    voice->m_fixedPos += (qint64)samplesToMix << GEFixedPosBits;
+    return samplesToMix;
+}
+
+
+/*!
+  Mixing kernel for IMA ADPCM compressed buffers with \a Channels channels.
+  The blocks are decoded into the cache of the voice as the position
+  advances, so each block is decoded once per pass. Interpolates linearly
+  like mixBlockKernel().
+
+  Note: Does not do any bound checking, must be checked before called!
+*/
+template <int Channels>
+int AudioVoice::mixBlockAdpcm(AudioVoice *voice,
+                              AUDIO_SAMPLE_TYPE *target,
+                              int samplesToMix)
+{
+    const int blockFrames(voice->m_buffer->getSamplesPerBlock());
+    const int leftVolume(voice->m_fixedLeftVolume);
+    const int rightVolume(voice->m_fixedRightVolume);
+    const qint64 fixedInc(voice->m_fixedInc);
+
+    if (!voice->m_blockCache || blockFrames <= 0)
+        return 0;
+
+    int mixed(0);
+
+    while (mixed < samplesToMix) {
+        const int block((int)(voice->m_fixedPos >> GEFixedPosBits) /
+                        blockFrames);
+
+        if (block != voice->m_cachedBlock)
+            voice->cacheBlocks(block);
+
+        // Mix until the position leaves the first cached block, the frame
+        // following it is the first one of the second block.
+        const qint64 blockStart((qint64)block * blockFrames << GEFixedPosBits);
+        const int amount(voice->samplesBefore(
+            blockStart + ((qint64)blockFrames << GEFixedPosBits),
+            samplesToMix - mixed));
+        const AUDIO_SAMPLE_TYPE *source = voice->m_blockCache;
+        qint64 fixedPos(voice->m_fixedPos - blockStart);
+
+        AUDIO_SAMPLE_TYPE *t_target = target + (mixed + amount) * 2;
+        AUDIO_SAMPLE_TYPE *output = target + mixed * 2;
+        int sourcepos(0);
+        int frac(0);
+
+        while (output != t_target) {
+            sourcepos = (int)(fixedPos >> GEFixedPosBits) * Channels;
+            frac = (int)(fixedPos >> GEInterpolationShift) & 4095;
+
+            const int left((source[sourcepos] * (4096 - frac) +
+                            source[sourcepos + Channels] * frac) >> 12);
+            const int right((Channels == 2) ?
+                            ((source[sourcepos + 1] * (4096 - frac) +
+                              source[sourcepos + 3] * frac) >> 12) : left);
+
+            output[0] = ((left * leftVolume) >> 12);
+            output[1] = ((right * rightVolume) >> 12);
+
+            fixedPos += fixedInc;
+            output += 2;
+        }
+
+        voice->m_fixedPos = blockStart + fixedPos;
+        mixed += amount;
+    }
+
+    return samplesToMix;
+}
+
+
+/*!
+  Decodes \a block and the block following it into the block cache. When
+  moving on to the next block, the already decoded one is reused. Frames
+  past the end of the data are set to zero.
+*/
+void AudioVoice::cacheBlocks(int block)
+{
+    const int channels(m_buffer->getNofChannels());
+    const int blockAlign(m_buffer->getBlockAlign());
+    const int blockSamples(m_buffer->getSamplesPerBlock() * channels);
+    const int dataLength(m_buffer->getDataLength());
+    const char *data = (const char*)m_buffer->getRawData();
+    int first(0);
+
+    if (m_cachedBlock >= 0 && block == m_cachedBlock + 1) {
+        // Playing forward, the second block becomes the first one.
+        memcpy(m_blockCache, m_blockCache + blockSamples,
+               blockSamples * sizeof(AUDIO_SAMPLE_TYPE));
+        first = 1;
+    }
+
+    for (int i = first; i < 2; i++) {
+        const int offset((block + i) * blockAlign);
+        AUDIO_SAMPLE_TYPE *target = m_blockCache + i * blockSamples;
+        int frames(0);
+
+        if (offset < dataLength) {
+            frames = AudioAdpcm::decodeBlock(
+                data + offset, qMin(blockAlign, dataLength - offset),
+                channels, target);
+        }
+
+        memset(target + frames * channels, 0,
+               (blockSamples - frames * channels) * sizeof(AUDIO_SAMPLE_TYPE));
+    }
+
+    m_cachedBlock = block;
+}
+
+
+/*!
+  Reference implementation of mixBlock() using the per-sample functions of
+  AudioBuffer. Kept for verifying the output of the specialized kernels.
+
+  Note: Does not do any bound checking, must be checked before called!
+*/
+int AudioVoice::mixBlockReference(AUDIO_SAMPLE_TYPE *target,
+                                  int samplesToMix)
+{
+    SAMPLE_FUNCTION_TYPE sampleFunction = m_buffer->getSampleFunction();
+
+    if (!sampleFunction) {
+        // Unsupported sample type.
+        return 0;
+    }
+
+    AUDIO_SAMPLE_TYPE *t_target = target + samplesToMix * 2;
+    int sourcepos(0);
+    int frac(0);
+
+    if (m_buffer->getNofChannels() == 2) {
+        // Stereo
+        while (target != t_target) {
+            sourcepos = (int)(m_fixedPos >> GEFixedPosBits);
+            frac = (int)(m_fixedPos >> GEInterpolationShift) & 4095;
+
+            target[0] = (((((sampleFunction)
+                            (m_buffer, sourcepos, 0) * (4096 - frac) +
+                            (sampleFunction)(m_buffer, sourcepos + 1, 0) *
+                            frac) >> 12) *
+                          m_fixedLeftVolume) >> 12);
+
+            target[1] = (((((sampleFunction)
+                            (m_buffer, sourcepos, 1) * (4096 - frac) +
+                            (sampleFunction)(m_buffer, sourcepos + 1, 1) *
+                            frac) >> 12) *
+                          m_fixedRightVolume) >> 12);
+
+            m_fixedPos += m_fixedInc;
+            target += 2;
+        }
+    }
+    else {
+        // Mono
+        int temp(0);
+
+        while (target != t_target) {
+            sourcepos = (int)(m_fixedPos >> GEFixedPosBits);
+            frac = (int)(m_fixedPos >> GEInterpolationShift) & 4095;
+
+            temp = (((sampleFunction)(m_buffer, sourcepos, 0) *
+                     (4096 - frac) +
+                     (sampleFunction)(m_buffer, sourcepos + 1, 0) *
+                     frac) >> 12);
+
+            target[0] = ((temp * m_fixedLeftVolume) >> 12);
+            target[1] = ((temp * m_fixedRightVolume) >> 12);
+
+            m_fixedPos += m_fixedInc;
+            target += 2;
+        }
+    }
+
+    return samplesToMix;
+}
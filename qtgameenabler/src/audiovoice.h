@@ -0,0 +1,132 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#ifndef GEAUDIOVOICE_H
+#define GEAUDIOVOICE_H
+
+#include <QAtomicInt>
+#include "audiosourceif.h"
+
+
+namespace GE {
+
+// Forward declarations
+class AudioBuffer;
+class AudioVoice;
+
+// Prototype function for the specialized mixing kernels
+typedef int (*MIX_FUNCTION_TYPE)(AudioVoice *voice,
+                                 AUDIO_SAMPLE_TYPE *target,
+                                 int samplesToMix);
+
+
+class AudioVoice
+{
+public: // Data types
+
+    enum InterpolationMode {
+        LinearInterpolation = 0, // Two taps, the cheapest
+        CubicInterpolation = 1, // Four-tap Catmull-Rom spline
+        SincInterpolation = 2, // Eight-tap windowed sinc, band-limited
+        InterpolationModeCount = 3
+    };
+
+public:
+    explicit AudioVoice(AudioBuffer *buffer = 0);
+    ~AudioVoice();
+
+public:
+    inline AudioBuffer *buffer() const { return m_buffer; }
+    bool isPlaying() const;
+    inline bool isFinished() const { return m_finished; }
+
+    void play(AudioBuffer *buffer, int loopCount = 0);
+    void play(AudioBuffer *buffer,
+              float volume,
+              float speed,
+              int loopCount = 0);
+    void stop();
+    void setLoopCount(int count);
+    void setSpeed(float speed);
+    void setLeftVolume(float volume);
+    void setRightVolume(float volume);
+    void setInterpolationMode(InterpolationMode mode);
+    inline InterpolationMode interpolationMode() const
+        { return m_interpolationMode; }
+
+    int audibleVolume() const;
+    int pullAudio(AUDIO_SAMPLE_TYPE *target, int bufferLength);
+    int skipAudio(int bufferLength);
+
+protected:
+    int mixBlock(AUDIO_SAMPLE_TYPE *target, int samplesToMix);
+    int mixBlockReference(AUDIO_SAMPLE_TYPE *target, int samplesToMix);
+    void applyPendingChanges();
+    int samplesBefore(qint64 fixedEnd, int maxSamples) const;
+    bool setMixFunction();
+
+    template <class Reader, int Channels>
+    void selectMixFunctions();
+
+    template <class Reader, int Channels>
+    static int mixBlockKernel(AudioVoice *voice,
+                              AUDIO_SAMPLE_TYPE *target,
+                              int samplesToMix);
+
+    template <class Reader, int Channels, int Taps>
+    static int mixBlockFiltered(AudioVoice *voice,
+                                AUDIO_SAMPLE_TYPE *target,
+                                int samplesToMix);
+
+    template <class Reader, int Channels, int Taps, bool Clamp>
+    static void filterBlock(AudioVoice *voice,
+                            AUDIO_SAMPLE_TYPE *target,
+                            int samplesToMix,
+                            int lastFrame);
+
+    static int copyBlockStereo(AudioVoice *voice,
+                               AUDIO_SAMPLE_TYPE *target,
+                               int samplesToMix);
+
+    template <int Channels>
+    static int mixBlockAdpcm(AudioVoice *voice,
+                             AUDIO_SAMPLE_TYPE *target,
+                             int samplesToMix);
+
+    void cacheBlocks(int block);
+
+protected: // Data
+    AudioBuffer *m_buffer; // Not owned
+    MIX_FUNCTION_TYPE m_mixFunctions[InterpolationModeCount];
+    MIX_FUNCTION_TYPE m_copyFunction; // For the normal speed, may be NULL
+    bool m_finished;
+    // Written by the mixing thread only, 64-bit stores may be torn
+    qint64 m_fixedPos; // 32.32 fixed point, in source frames
+    qint64 m_fixedInc; // 32.32 fixed point, source frames per mixed frame
+    double m_fixedIncReciprocal; // 1 / m_fixedInc
+    int m_sampleRate; // The mixing rate m_fixedInc was computed for
+    float m_speed; // The speed m_fixedInc was computed for
+
+    // Set from any thread, see applyPendingChanges()
+    QAtomicInt m_pendingSpeed; // The bits of the float set with setSpeed()
+    QAtomicInt m_pendingRestart; // 1 if play() was called
+    int m_fixedLeftVolume;
+    int m_fixedRightVolume;
+    int m_loopCount;
+    InterpolationMode m_interpolationMode;
+
+    // Decoded blocks of a compressed buffer
+    AUDIO_SAMPLE_TYPE *m_blockCache; // Owned
+    int m_blockCacheLength; // In samples
+    int m_cachedBlock; // The first of the two cached blocks, -1 if none
+
+private:
+    Q_DISABLE_COPY(AudioVoice)
+};
+
+} // namespace GE
+
+#endif // GEAUDIOVOICE_H
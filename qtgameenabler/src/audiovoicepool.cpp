@@ -0,0 +1,373 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#include "audiovoicepool.h"
+#include <memory.h>
+#include "audiobuffer.h"
+#include "trace.h" // For debug macros
+
+using namespace GE;
+
+// Constants
+const int GEVoiceIndexBits(16);
+const quint32 GEVoiceIndexMask((1 << GEVoiceIndexBits) - 1);
+const int GEMaxVoicePoolCapacity(1 << GEVoiceIndexBits);
+
+
+/*!
+  \class AudioVoicePool
+  \brief An AudioSource mixing a fixed number of preallocated voices.
+
+  Starting a voice with play() does not allocate any memory nor construct
+  any QObjects, which makes the pool well suited for frequent one-shot
+  effects. The voices are referenced with VoiceHandle values which become
+  invalid once the voice has finished; operations on an invalid handle are
+  ignored. The finished voices are recycled by the audio thread.
+
+  The voiceFinished() signals are delivered in batches by
+  dispatchFinished(), which should be called periodically from the thread
+  owning the pool, for example once per frame.
+
+  The pool is used from the game thread (play(), stop() and the setters)
+  and from the audio thread (pullAudio()).
+*/
+
+
+/*!
+  Constructor. Preallocates \a capacity voices.
+*/
+AudioVoicePool::AudioVoicePool(int capacity /* = GEDefaultVoicePoolCapacity */,
+                               QObject *parent /* = 0 */)
+    : AudioSource(parent),
+      m_slots(0),
+      m_capacity(qBound(1, capacity, GEMaxVoicePoolCapacity)),
+      m_nextSlot(0),
+      m_activeVoiceCount(0),
+      m_voiceBuffer(0),
+      m_voiceBufferLength(0),
+      m_accumulateFunction(AudioKernels::accumulateFunction()),
+      m_defaultInterpolationMode(AudioVoice::LinearInterpolation)
+{
+    m_slots = new VoiceSlot[m_capacity];
+
+    for (int i = 0; i < m_capacity; i++) {
+        m_slots[i].state = FreeSlot;
+        m_slots[i].generation = 1;
+        m_slots[i].stopGeneration = 0;
+    }
+}
+
+
+/*!
+  Destructor.
+*/
+AudioVoicePool::~AudioVoicePool()
+{
+    delete [] m_slots;
+    AudioKernels::freeBuffer(m_voiceBuffer);
+}
+
+
+/*!
+  Returns the number of voices currently playing.
+*/
+int AudioVoicePool::activeVoiceCount() const
+{
+    return m_activeVoiceCount;
+}
+
+
+/*!
+  Starts playing \a buffer with \a volume and \a speed in a free voice. If
+  the given loop count is -1, the buffer will be repeated forever. The voice
+  uses the default interpolation mode of the pool.
+
+  Returns the handle of the voice or GEInvalidVoiceHandle if all the voices
+  are in use.
+*/
+VoiceHandle AudioVoicePool::play(AudioBuffer *buffer,
+                                 float volume /* = 1.0f */,
+                                 float speed /* = 1.0f */,
+                                 int loopCount /* = 0 */)
+{
+    if (!buffer)
+        return GEInvalidVoiceHandle;
+
+    for (int i = 0; i < m_capacity; i++) {
+        const int index((m_nextSlot + i) % m_capacity);
+        VoiceSlot &slot = m_slots[index];
+
+        if (!slot.state.testAndSetAcquire(FreeSlot, ReservedSlot))
+            continue;
+
+        // The slot is now reserved for us, the audio thread will not touch
+        // it until it is published as playing.
+        slot.voice.play(buffer, volume, speed, loopCount);
+        slot.voice.setInterpolationMode(m_defaultInterpolationMode);
+        slot.stopGeneration = 0;
+
+        const int generation(slot.generation);
+        m_nextSlot = (index + 1) % m_capacity;
+        m_activeVoiceCount.ref();
+        slot.state.fetchAndStoreRelease(PlayingSlot);
+
+        return ((VoiceHandle)generation << GEVoiceIndexBits) | index;
+    }
+
+    DEBUG_INFO("All the" << m_capacity << "voices are in use!");
+    return GEInvalidVoiceHandle;
+}
+
+
+/*!
+  Stops the voice referenced by \a handle. The voice is stopped and recycled
+  by the audio thread during the next mixed block. Returns true if the
+  handle was valid, false otherwise.
+*/
+bool AudioVoicePool::stop(VoiceHandle handle)
+{
+    VoiceSlot *slot = slotFor(handle);
+
+    if (!slot)
+        return false;
+
+    slot->stopGeneration = (int)(handle >> GEVoiceIndexBits);
+    return true;
+}
+
+
+/*!
+  Returns true if the voice referenced by \a handle is still playing, false
+  otherwise.
+*/
+bool AudioVoicePool::isPlaying(VoiceHandle handle) const
+{
+    return (slotFor(handle) != 0);
+}
+
+
+/*!
+  Sets \a leftVolume and \a rightVolume for the voice referenced by
+  \a handle. Returns true if the handle was valid, false otherwise.
+*/
+bool AudioVoicePool::setVolume(VoiceHandle handle,
+                               float leftVolume,
+                               float rightVolume)
+{
+    VoiceSlot *slot = slotFor(handle);
+
+    if (!slot)
+        return false;
+
+    slot->voice.setLeftVolume(leftVolume);
+    slot->voice.setRightVolume(rightVolume);
+    return true;
+}
+
+
+/*!
+  Sets \a speed for the voice referenced by \a handle. Returns true if the
+  handle was valid, false otherwise.
+*/
+bool AudioVoicePool::setSpeed(VoiceHandle handle, float speed)
+{
+    VoiceSlot *slot = slotFor(handle);
+
+    if (!slot)
+        return false;
+
+    slot->voice.setSpeed(speed);
+    return true;
+}
+
+
+/*!
+  Sets the loop count of the voice referenced by \a handle to \a count.
+  Returns true if the handle was valid, false otherwise.
+*/
+bool AudioVoicePool::setLoopCount(VoiceHandle handle, int count)
+{
+    VoiceSlot *slot = slotFor(handle);
+
+    if (!slot)
+        return false;
+
+    slot->voice.setLoopCount(count);
+    return true;
+}
+
+
+/*!
+  Sets the interpolation \a mode of the voice referenced by \a handle.
+  Returns true if the handle was valid, false otherwise.
+*/
+bool AudioVoicePool::setInterpolationMode(VoiceHandle handle,
+                                          AudioVoice::InterpolationMode mode)
+{
+    VoiceSlot *slot = slotFor(handle);
+
+    if (!slot)
+        return false;
+
+    slot->voice.setInterpolationMode(mode);
+    return true;
+}
+
+
+/*!
+  Sets the interpolation \a mode used by the voices started with play()
+  from now on.
+*/
+void AudioVoicePool::setDefaultInterpolationMode(
+        AudioVoice::InterpolationMode mode)
+{
+    m_defaultInterpolationMode = mode;
+}
+
+
+/*!
+  From AudioSource.
+
+  Returns GEMaxAudioVolumeValue if any of the voices is playing, 0 otherwise.
+*/
+int AudioVoicePool::audibleVolume() const
+{
+    return (m_activeVoiceCount > 0) ? (int)GEMaxAudioVolumeValue : 0;
+}
+
+
+/*!
+  From AudioSource.
+
+  Mixes all the playing voices into \a target. The finished voices are
+  recycled and reported with the next dispatchFinished() call.
+*/
+int AudioVoicePool::pullAudio(AUDIO_SAMPLE_TYPE *target, int bufferLength)
+{
+    if (m_activeVoiceCount == 0)
+        return 0;
+
+    if (m_voiceBufferLength < bufferLength) {
+        AudioKernels::freeBuffer(m_voiceBuffer);
+        m_voiceBufferLength = bufferLength;
+        m_voiceBuffer = (AUDIO_SAMPLE_TYPE*)AudioKernels::allocateBuffer(
+            sizeof(AUDIO_SAMPLE_TYPE) * m_voiceBufferLength);
+    }
+
+    memset(target, 0, sizeof(AUDIO_SAMPLE_TYPE) * bufferLength);
+
+    for (int i = 0; i < m_capacity; i++) {
+        VoiceSlot &slot = m_slots[i];
+
+        if (slot.state.fetchAndAddAcquire(0) != PlayingSlot)
+            continue;
+
+        if (slot.stopGeneration == slot.generation)
+            slot.voice.stop();
+
+        const int mixed(slot.voice.pullAudio(m_voiceBuffer, bufferLength));
+
+        if (mixed > 0) {
+            (m_accumulateFunction)(target, m_voiceBuffer, mixed,
+                                   (int)GEMaxAudioVolumeValue);
+        }
+
+        if (!slot.voice.isPlaying())
+            releaseSlot(i);
+    }
+
+    return bufferLength;
+}
+
+
+/*!
+  From AudioSource.
+
+  Advances all the playing voices without mixing them. The finished voices
+  are recycled as in pullAudio().
+*/
+void AudioVoicePool::skipAudio(AUDIO_SAMPLE_TYPE *scratch, int bufferLength)
+{
+    Q_UNUSED(scratch);
+
+    for (int i = 0; i < m_capacity; i++) {
+        VoiceSlot &slot = m_slots[i];
+
+        if (slot.state.fetchAndAddAcquire(0) != PlayingSlot)
+            continue;
+
+        if (slot.stopGeneration == slot.generation)
+            slot.voice.stop();
+
+        slot.voice.skipAudio(bufferLength);
+
+        if (!slot.voice.isPlaying())
+            releaseSlot(i);
+    }
+}
+
+
+/*!
+  Emits voiceFinished() for every voice finished since the previous call.
+  Must be called from the thread owning the pool.
+*/
+void AudioVoicePool::dispatchFinished()
+{
+    VoiceHandle handle(GEInvalidVoiceHandle);
+
+    while (m_finishedQueue.pop(handle))
+        emit voiceFinished(handle);
+}
+
+
+/*!
+  Returns the slot referenced by \a handle or NULL if the handle is not
+  valid (anymore).
+*/
+AudioVoicePool::VoiceSlot *AudioVoicePool::slotFor(VoiceHandle handle) const
+{
+    const int index((int)(handle & GEVoiceIndexMask));
+
+    if (handle == GEInvalidVoiceHandle || index >= m_capacity)
+        return 0;
+
+    VoiceSlot *slot = &m_slots[index];
+
+    if (slot->state.fetchAndAddAcquire(0) != PlayingSlot ||
+        slot->generation != (int)(handle >> GEVoiceIndexBits)) {
+        return 0;
+    }
+
+    return slot;
+}
+
+
+/*!
+  Called from the audio thread. Invalidates the handles of the voice in the
+  slot of \a index, queues the finished notification and marks the slot as
+  free.
+*/
+void AudioVoicePool::releaseSlot(int index)
+{
+    VoiceSlot &slot = m_slots[index];
+    const int generation(slot.generation);
+
+    // Skip 0 so that a valid handle is never GEInvalidVoiceHandle.
+    int nextGeneration((generation + 1) & 0xffff);
+
+    if (nextGeneration == 0)
+        nextGeneration = 1;
+
+    slot.generation = nextGeneration;
+
+    if (!m_finishedQueue.push(
+            ((VoiceHandle)generation << GEVoiceIndexBits) | index)) {
+        DEBUG_INFO("Finished notification dropped, the queue is full!");
+    }
+
+    m_activeVoiceCount.deref();
+    slot.state.fetchAndStoreRelease(FreeSlot);
+}
@@ -0,0 +1,104 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#ifndef GEAUDIOVOICEPOOL_H
+#define GEAUDIOVOICEPOOL_H
+
+#include <QAtomicInt>
+#include "audiokernels.h"
+#include "audiosourceif.h"
+#include "audiovoice.h"
+#include "lockfreequeue.h"
+
+
+namespace GE {
+
+// Forward declarations
+class AudioBuffer;
+
+// A generation-checked reference to a voice of an AudioVoicePool
+typedef quint32 VoiceHandle;
+
+// Constants
+const VoiceHandle GEInvalidVoiceHandle(0);
+const int GEDefaultVoicePoolCapacity(32);
+const int GEVoicePoolEventQueueSize(256); // Must be a power of two
+
+
+class AudioVoicePool : public AudioSource
+{
+    Q_OBJECT
+
+public:
+    explicit AudioVoicePool(int capacity = GEDefaultVoicePoolCapacity,
+                            QObject *parent = 0);
+    virtual ~AudioVoicePool();
+
+public:
+    inline int capacity() const { return m_capacity; }
+    int activeVoiceCount() const;
+
+    VoiceHandle play(AudioBuffer *buffer,
+                     float volume = 1.0f,
+                     float speed = 1.0f,
+                     int loopCount = 0);
+    bool stop(VoiceHandle handle);
+    bool isPlaying(VoiceHandle handle) const;
+    bool setVolume(VoiceHandle handle, float leftVolume, float rightVolume);
+    bool setSpeed(VoiceHandle handle, float speed);
+    bool setLoopCount(VoiceHandle handle, int count);
+    bool setInterpolationMode(VoiceHandle handle,
+                              AudioVoice::InterpolationMode mode);
+
+    void setDefaultInterpolationMode(AudioVoice::InterpolationMode mode);
+    inline AudioVoice::InterpolationMode defaultInterpolationMode() const
+        { return m_defaultInterpolationMode; }
+
+public: // From AudioSource
+    int audibleVolume() const;
+    int pullAudio(AUDIO_SAMPLE_TYPE *target, int bufferLength);
+    void skipAudio(AUDIO_SAMPLE_TYPE *scratch, int bufferLength);
+
+public slots:
+    void dispatchFinished();
+
+signals:
+    void voiceFinished(quint32 handle);
+
+protected: // Data types
+
+    enum SlotState {
+        FreeSlot = 0,
+        ReservedSlot = 1, // Being set up by play()
+        PlayingSlot = 2
+    };
+
+    struct VoiceSlot {
+        AudioVoice voice;
+        QAtomicInt state;
+        QAtomicInt generation;
+        QAtomicInt stopGeneration;
+    };
+
+protected:
+    VoiceSlot *slotFor(VoiceHandle handle) const;
+    void releaseSlot(int index);
+
+protected: // Data
+    VoiceSlot *m_slots; // Owned
+    int m_capacity;
+    int m_nextSlot;
+    QAtomicInt m_activeVoiceCount;
+    SpscQueue<VoiceHandle, GEVoicePoolEventQueueSize> m_finishedQueue;
+    AUDIO_SAMPLE_TYPE *m_voiceBuffer; // Owned
+    int m_voiceBufferLength;
+    ACCUMULATE_FUNCTION_TYPE m_accumulateFunction;
+    AudioVoice::InterpolationMode m_defaultInterpolationMode;
+};
+
+} // namespace GE
+
+#endif // GEAUDIOVOICEPOOL_H
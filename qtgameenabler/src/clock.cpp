@@ -0,0 +1,93 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#include "clock.h"
+#include <QElapsedTimer>
+
+#if defined(Q_OS_WIN)
+#include <windows.h>
+#elif defined(Q_OS_SYMBIAN)
+#include <e32std.h>
+#elif defined(Q_OS_UNIX)
+#include <time.h>
+#endif
+
+using namespace GE;
+
+
+/*!
+  \class Clock
+  \brief The monotonic nanosecond clock of the frames and the profiler.
+
+  Depends on the platform only, not on the GUI, so that it can be used from
+  any thread, for example the audio thread.
+*/
+
+
+/*!
+  Returns the time of a monotonic clock in nanoseconds. The clock is not
+  affected by changes of the wall-clock time and never wraps; only the
+  differences of the values are meaningful. The resolution depends on the
+  platform: CLOCK_MONOTONIC on Unix, the performance counter on Windows and
+  milliseconds elsewhere. Thread safe.
+*/
+qint64 Clock::tickCountNs()
+{
+#if defined(Q_OS_WIN)
+    LARGE_INTEGER frequency;
+    LARGE_INTEGER counter;
+
+    if (QueryPerformanceFrequency(&frequency) && frequency.QuadPart > 0 &&
+        QueryPerformanceCounter(&counter)) {
+        // In two parts to avoid overflowing.
+        const qint64 seconds(counter.QuadPart / frequency.QuadPart);
+        const qint64 rest(counter.QuadPart % frequency.QuadPart);
+        return seconds * Q_INT64_C(1000000000) +
+            rest * Q_INT64_C(1000000000) / frequency.QuadPart;
+    }
+#elif defined(Q_OS_UNIX) && !defined(Q_OS_SYMBIAN)
+    struct timespec now;
+
+    if (clock_gettime(CLOCK_MONOTONIC, &now) == 0)
+        return (qint64)now.tv_sec * Q_INT64_C(1000000000) + now.tv_nsec;
+#endif
+
+    // Fall back to the millisecond clock of Qt, monotonic where available.
+    QElapsedTimer timer;
+    timer.start();
+    return timer.msecsSinceReference() * Q_INT64_C(1000000);
+}
+
+
+/*!
+  Blocks the calling thread until tickCountNs() reaches \a deadline. Where
+  a precise sleep is not available, returns early by less than one
+  millisecond.
+*/
+void Clock::sleepUntilNs(qint64 deadline)
+{
+#if defined(Q_OS_UNIX) && !defined(Q_OS_SYMBIAN)
+    struct timespec until;
+    until.tv_sec = (time_t)(deadline / Q_INT64_C(1000000000));
+    until.tv_nsec = (long)(deadline % Q_INT64_C(1000000000));
+
+    // Absolute time, restarted with the same value if interrupted.
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &until, 0) != 0) {
+        if (tickCountNs() >= deadline)
+            break;
+    }
+#else
+    const qint64 remaining(deadline - tickCountNs());
+
+    if (remaining >= Q_INT64_C(1000000)) {
+#if defined(Q_OS_WIN)
+        Sleep((DWORD)(remaining / 1000000));
+#elif defined(Q_OS_SYMBIAN)
+        User::AfterHighRes((TInt)(remaining / 1000));
+#endif
+    }
+#endif
+}
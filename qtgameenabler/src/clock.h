@@ -0,0 +1,24 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#ifndef GECLOCK_H
+#define GECLOCK_H
+
+#include <QtGlobal>
+
+
+namespace GE {
+
+class Clock
+{
+public:
+    static qint64 tickCountNs();
+    static void sleepUntilNs(qint64 deadline);
+};
+
+} // namespace GE
+
+#endif // GECLOCK_H
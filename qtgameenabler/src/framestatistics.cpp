@@ -0,0 +1,207 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#include "framestatistics.h"
+#include <QtAlgorithms>
+#include <math.h>
+#include <memory.h>
+
+using namespace GE;
+
+
+/*!
+  \class FrameStatistics
+  \brief A ring of the durations of the latest frames, split into phases.
+
+  GameWindow adds each frame with addFrame() and the statistics are computed
+  only when queried, so the recording costs a few stores per frame. The
+  durations are in nanoseconds internally and the queries return seconds.
+
+  The ring is a SnapshotRing with a single writer: the queries can be made
+  from any thread while the frames are being added. A query made from
+  another thread skips the frames overwritten while it was reading the
+  ring.
+*/
+
+
+/*!
+  Constructor. The capacity is \a minimumCapacity frames rounded up to the
+  next power of two.
+*/
+FrameStatistics::FrameStatistics(
+        int minimumCapacity /* = GEDefaultFrameStatisticsCapacity */)
+    : m_records(minimumCapacity),
+      m_count(0),
+      m_frameTimeSum(0)
+{
+}
+
+
+/*!
+  Destructor.
+*/
+FrameStatistics::~FrameStatistics()
+{
+}
+
+
+/*!
+  Returns the number of frames in the ring, at most capacity().
+*/
+int FrameStatistics::count() const
+{
+    return m_count;
+}
+
+
+/*!
+  Adds a frame with the durations of its phases in nanoseconds, replacing
+  the oldest frame if the ring is full. To be called by the writer thread
+  only.
+*/
+void FrameStatistics::addFrame(qint64 updateNs,
+                               qint64 renderNs,
+                               qint64 swapNs,
+                               qint64 frameNs)
+{
+    Record &record = m_records.next();
+
+    if (m_count == m_records.capacity())
+        m_frameTimeSum -= record.duration[FramePhase];
+    else
+        m_count++;
+
+    record.duration[UpdatePhase] = updateNs;
+    record.duration[RenderPhase] = renderNs;
+    record.duration[SwapPhase] = swapNs;
+    record.duration[FramePhase] = frameNs;
+    m_frameTimeSum += frameNs;
+
+    m_records.publish();
+}
+
+
+/*!
+  Drops all the frames. To be called by the writer thread only.
+*/
+void FrameStatistics::reset()
+{
+    m_count = 0;
+    m_frameTimeSum = 0;
+    m_records.clear();
+}
+
+
+/*!
+  Returns the average frame rate over the frames in the ring, 0 if there
+  are none. Cheap, but exact only when called from the writer thread.
+*/
+double FrameStatistics::frameRate() const
+{
+    if (m_frameTimeSum <= 0)
+        return 0.0;
+
+    return (double)m_count * 1.0e9 / (double)m_frameTimeSum;
+}
+
+
+/*!
+  Returns the count, the mean, the extremes and the 50th, 95th and 99th
+  percentiles of the durations of \a phase over the frames in the ring. All
+  the values are 0 if there are no frames.
+*/
+FrameStatistics::Summary FrameStatistics::summary(Phase phase) const
+{
+    QVector<qint64> values(durations(phase));
+    Summary result;
+    memset(&result, 0, sizeof(Summary));
+    result.count = values.count();
+
+    if (values.isEmpty())
+        return result;
+
+    qSort(values.begin(), values.end());
+
+    qint64 sum(0);
+
+    for (int i = 0; i < values.count(); i++)
+        sum += values[i];
+
+    // Nearest rank.
+    const int n(values.count());
+    const int p50(qBound(0, (int)ceil(0.50 * n) - 1, n - 1));
+    const int p95(qBound(0, (int)ceil(0.95 * n) - 1, n - 1));
+    const int p99(qBound(0, (int)ceil(0.99 * n) - 1, n - 1));
+
+    result.mean = (double)sum * 1.0e-9 / n;
+    result.minimum = (double)values.first() * 1.0e-9;
+    result.maximum = (double)values.last() * 1.0e-9;
+    result.p50 = (double)values[p50] * 1.0e-9;
+    result.p95 = (double)values[p95] * 1.0e-9;
+    result.p99 = (double)values[p99] * 1.0e-9;
+    return result;
+}
+
+
+/*!
+  Returns the duration of \a phase in seconds below or at which \a fraction
+  (from 0 to 1) of the frames in the ring are, 0 if there are no frames.
+*/
+double FrameStatistics::percentile(Phase phase, double fraction) const
+{
+    QVector<qint64> values(durations(phase));
+
+    if (values.isEmpty())
+        return 0.0;
+
+    qSort(values.begin(), values.end());
+
+    const int n(values.count());
+    const int rank(qBound(0, (int)ceil(fraction * n) - 1, n - 1));
+    return (double)values[rank] * 1.0e-9;
+}
+
+
+/*!
+  Returns the number of frames in the ring by the duration of \a phase, in
+  \a binCount bins of \a binWidth seconds each starting from 0. The last bin
+  also counts the longer durations.
+*/
+QVector<int> FrameStatistics::histogram(Phase phase,
+                                        double binWidth,
+                                        int binCount) const
+{
+    if (binWidth <= 0.0 || binCount <= 0)
+        return QVector<int>();
+
+    const QVector<qint64> values(durations(phase));
+    const double binsPerNs(1.0e-9 / binWidth);
+    QVector<int> bins(binCount, 0);
+
+    for (int i = 0; i < values.count(); i++) {
+        const double bin((double)values[i] * binsPerNs);
+        bins[(bin < binCount - 1) ? qMax(0, (int)bin) : binCount - 1]++;
+    }
+
+    return bins;
+}
+
+
+/*!
+  Returns a copy of the durations of \a phase in the ring, the oldest
+  first.
+*/
+QVector<qint64> FrameStatistics::durations(Phase phase) const
+{
+    const QVector<Record> records(m_records.snapshot());
+    QVector<qint64> values;
+    values.resize(records.count());
+
+    for (int i = 0; i < records.count(); i++)
+        values[i] = records[i].duration[phase];
+
+    return values;
+}
@@ -0,0 +1,79 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#ifndef GEFRAMESTATISTICS_H
+#define GEFRAMESTATISTICS_H
+
+#include <QVector>
+#include "snapshotring.h"
+
+
+namespace GE {
+
+// Constants
+const int GEDefaultFrameStatisticsCapacity(128); // In frames
+
+
+class FrameStatistics
+{
+public: // Data types
+
+    enum Phase {
+        UpdatePhase = 0, // update() and the audio ticks
+        RenderPhase, // onRender()
+        SwapPhase, // eglSwapBuffers()
+        FramePhase, // From the start of a frame to the start of the next
+        PhaseCount
+    };
+
+    struct Summary {
+        int count; // Of the frames, the rest are in seconds
+        double mean;
+        double minimum;
+        double maximum;
+        double p50;
+        double p95;
+        double p99;
+    };
+
+public:
+    explicit FrameStatistics(
+            int minimumCapacity = GEDefaultFrameStatisticsCapacity);
+    ~FrameStatistics();
+
+public:
+    inline int capacity() const { return m_records.capacity(); }
+    int count() const;
+    void addFrame(qint64 updateNs, qint64 renderNs, qint64 swapNs,
+                  qint64 frameNs);
+    void reset();
+
+    double frameRate() const;
+    Summary summary(Phase phase) const;
+    double percentile(Phase phase, double fraction) const;
+    QVector<int> histogram(Phase phase, double binWidth, int binCount) const;
+
+protected: // Data types
+
+    struct Record {
+        qint64 duration[PhaseCount]; // In nanoseconds
+    };
+
+protected:
+    QVector<qint64> durations(Phase phase) const;
+
+protected: // Data
+    SnapshotRing<Record> m_records;
+    int m_count; // Frames in the ring, written by the writer only
+    qint64 m_frameTimeSum; // Of the frames in the ring, writer only
+
+private:
+    Q_DISABLE_COPY(FrameStatistics)
+};
+
+} // namespace GE
+
+#endif // GEFRAMESTATISTICS_H
@@ -35,6 +35,8 @@ const TUint32 KHdScreen = 1;
 
 #endif
 
+#include "clock.h"
+#include "profiler.h"
 #include "trace.h" // For debug macros
 
 using namespace GE;
@@ -52,10 +54,24 @@ using namespace GE;
 */
 GameWindow::GameWindow(QWidget *parent /* = 0 */)
     : QWidget(parent),
+      eglDisplay(0),
+      eglConfig(0),
+      eglSurface(0),
+      eglContext(0),
       m_prevTime(0),
       m_currentTime(0),
+      m_frameDelta(0.0),
       m_frameTime(0.0f),
       m_fps(0.0f),
+      m_fixedTimeStep(0.0),
+      m_maxCatchUpSteps(GEDefaultMaxCatchUpSteps),
+      m_accumulator(0.0),
+      m_interpolationAlpha(1.0),
+      m_droppedStepCount(0),
+      m_swapInterval(GEDefaultSwapInterval),
+      m_targetFrameRate(0),
+      m_frameDeadline(0),
+      m_missedDeadlineCount(0),
       m_paused(true),
       m_timerId(0),
       m_audioOutput(0),
@@ -137,15 +153,17 @@ GameWindow::~GameWindow()
 void GameWindow::create()
 {
     DEBUG_POINT;
+    GE_PROFILE_THREAD("Game");
     setAttribute(Qt::WA_NoSystemBackground);
     createEGL();
 
     onCreate();
     onInitEGL();
 
-    m_currentTime = getTickCount();
+    m_currentTime = getTickCountNs();
     m_prevTime = m_currentTime;
     m_fps = 0.0f;
+    m_frameDelta = 0.0;
     m_frameTime = 0.0f;
 
     resume();
@@ -186,13 +204,87 @@ bool GameWindow::isProfileSilent() const
 
 
 /*!
-  Returns the tick count in milliseconds.
+  Enables the fixed timestep mode when \a step (in seconds) is greater than
+  zero, disables it otherwise.
+
+  In the fixed timestep mode updateFrame() is called with \a step as the
+  delta, as many times per frame as needed to keep up with the real time.
+  The cost and the stability of the simulation then do not depend on the
+  frame rate. The time left over is passed to onRenderInterpolated() as the
+  fraction of a step, for interpolating between the two latest simulated
+  states.
+
+  To avoid a spiral where slow steps cause even more steps, at most
+  \a maxCatchUpSteps steps are run per frame and the rest of the time is
+  dropped, see getDroppedStepCount(); the game then runs slower than the
+  real time.
+*/
+void GameWindow::setFixedTimeStep(
+        double step,
+        int maxCatchUpSteps /* = GEDefaultMaxCatchUpSteps */)
+{
+    m_fixedTimeStep = qMax(0.0, step);
+    m_maxCatchUpSteps = qMax(1, maxCatchUpSteps);
+    m_accumulator = 0.0;
+    m_interpolationAlpha = 1.0;
+}
+
+
+/*!
+  Sets the number of vertical syncs eglSwapBuffers() waits for to
+  \a interval. 0 disables the sync, 2 halves the frame rate, for example to
+  30 fps on a 60 Hz display. Applied to the current and later surfaces.
+*/
+void GameWindow::setSwapInterval(int interval)
+{
+    m_swapInterval = qMax(0, interval);
+
+    if (eglContext)
+        applySwapInterval();
+}
+
+
+/*!
+  Limits the frame rate to \a framesPerSecond, 0 to render as fast as
+  possible (the default).
+
+  By default the frames are rendered back to back and the thread is only
+  throttled by eglSwapBuffers(), if at all. When limited, each frame is
+  scheduled at a deadline and the thread sleeps until then, saving CPU time
+  and power when a lower frame rate suffices. A frame which is not ready by
+  its deadline counts as missed, see getMissedDeadlineCount(), and the
+  following frames are scheduled from the current time on.
+*/
+void GameWindow::setTargetFrameRate(int framesPerSecond)
+{
+    m_targetFrameRate = qMax(0, framesPerSecond);
+    m_frameDeadline = getTickCountNs();
+
+    if (m_timerId) {
+        // Running, reschedule.
+        killTimer(m_timerId);
+        m_timerId = startTimer(0);
+    }
+}
+
+
+/*!
+  Returns the time of the monotonic clock in nanoseconds, see
+  Clock::tickCountNs(). Thread safe.
+*/
+qint64 GameWindow::getTickCountNs()
+{
+    return Clock::tickCountNs();
+}
+
+
+/*!
+  Returns the tick count in milliseconds. Kept for compatibility, wraps
+  around after 49 days; see getTickCountNs().
 */
 unsigned int GameWindow::getTickCount() const
 {
-    QTime now = QTime::currentTime();
-    return (now.hour() * 3600 + now.minute() * 60 + now.second()) * 1000
-            + now.msec();
+    return (unsigned int)(getTickCountNs() / 1000000);
 }
 
 
@@ -230,6 +322,10 @@ void GameWindow::resume()
     if (!isProfileSilent())
         startAudio();
 
+    // The pause is not part of the next frame.
+    m_currentTime = getTickCountNs();
+    m_frameDeadline = m_currentTime;
+
     onResume();
     m_timerId = startTimer(0);
 }
@@ -435,7 +531,20 @@ void GameWindow::resizeEvent(QResizeEvent *event)
 void GameWindow::timerEvent(QTimerEvent *event)
 {
     Q_UNUSED(event); // To prevent compiler warnings.
+
+    if (m_targetFrameRate <= 0) {
+        render();
+        return;
+    }
+
+    // The timer has millisecond accuracy, sleep the rest of the time.
+    killTimer(m_timerId);
+    m_timerId = 0;
+    Clock::sleepUntilNs(m_frameDeadline);
     render();
+
+    if (!m_paused)
+        scheduleNextFrame();
 }
 
 /*!
@@ -484,6 +593,21 @@ void GameWindow::onRender()
 }
 
 
+/*!
+  Called when application needs to (re)render its screen. In the fixed
+  timestep mode \a alpha is the fraction of a step simulated ahead of the
+  latest state, in [0, 1), otherwise 1.0. See setFixedTimeStep().
+
+  To be implemented in the derived class. The default implementation calls
+  onRender().
+*/
+void GameWindow::onRenderInterpolated(const double alpha)
+{
+    Q_UNUSED(alpha);
+    onRender();
+}
+
+
 /*!
   Called when the framework is going into pause mode.
 
@@ -533,9 +657,20 @@ void GameWindow::onVolumeDown()
 
 /*!
   Called once before each frame, \a frameDelta attribute is set as the time
-  between current frame and the previous one.
+  between current frame and the previous one in seconds.
 
-  To be implemented in the derived class.
+  To be implemented in the derived class. The default implementation calls
+  update() for compatibility.
+*/
+void GameWindow::updateFrame(const double frameDelta)
+{
+    update((float)frameDelta);
+}
+
+
+/*!
+  Single precision version of updateFrame(), kept for compatibility. Called
+  only if updateFrame() is not overridden.
 */
 void GameWindow::update(const float frameDelta)
 {
@@ -640,36 +775,118 @@ void GameWindow::createEGL()
     if (!testEGLError("eglMakeCurrent")) {
         cleanupAndExit(eglDisplay);
     }
+
+    applySwapInterval();
+}
+
+
+/*!
+  Sets the swap interval of the current surface, see setSwapInterval().
+*/
+void GameWindow::applySwapInterval()
+{
+    if (!eglSwapInterval(eglDisplay, m_swapInterval))
+        DEBUG_INFO("eglSwapInterval() failed:" << eglGetError());
+}
+
+
+/*!
+  Advances the deadline of the frame by the frame period of the target frame
+  rate and starts the timer for it. If the deadline has already passed, the
+  frame is counted as missed and the deadline is moved to the first slot
+  ahead, so that the late frames are not rendered back to back.
+*/
+void GameWindow::scheduleNextFrame()
+{
+    const qint64 period(Q_INT64_C(1000000000) / m_targetFrameRate);
+    const qint64 now(getTickCountNs());
+
+    m_frameDeadline += period;
+
+    if (m_frameDeadline <= now) {
+        m_missedDeadlineCount++;
+        m_frameDeadline += ((now - m_frameDeadline) / period + 1) * period;
+    }
+
+    m_timerId = startTimer((int)((m_frameDeadline - now) / 1000000));
+}
+
+
+/*!
+  Runs the fixed steps due after the frame delta, see setFixedTimeStep().
+*/
+void GameWindow::runFixedSteps()
+{
+    m_accumulator += m_frameDelta;
+
+    int steps(0);
+
+    while (m_accumulator >= m_fixedTimeStep && steps < m_maxCatchUpSteps) {
+        GE_PROFILE_ZONE("GameWindow::update");
+        updateFrame(m_fixedTimeStep);
+        m_accumulator -= m_fixedTimeStep;
+        steps++;
+    }
+
+    if (m_accumulator >= m_fixedTimeStep) {
+        // Too far behind, drop the whole steps left.
+        const int dropped((int)(m_accumulator / m_fixedTimeStep));
+        m_droppedStepCount += dropped;
+        m_accumulator -= dropped * m_fixedTimeStep;
+    }
+
+    m_interpolationAlpha = m_accumulator / m_fixedTimeStep;
 }
 
 
 /*!
   Main run - method for the QtGameEnabler, processes a single frame and
-  calls necesseary functions of the application using QtGE: update and
-  onRender.
+  calls necesseary functions of the application using QtGE: updateFrame
+  and onRenderInterpolated.
 */
 void GameWindow::render()
 {
-    m_prevTime = m_currentTime;
-    m_currentTime = getTickCount();
-    m_frameTime = (float)(m_currentTime - m_prevTime) * 0.001f;
+    GE_PROFILE_ZONE("GameWindow::render");
 
-    if (m_frameTime != 0.0f)
-        m_fps = 1.0f / m_frameTime;
-    else
-        m_fps = 100000.0f;
+    m_prevTime = m_currentTime;
+    m_currentTime = getTickCountNs();
+    m_frameDelta = (double)(m_currentTime - m_prevTime) * 1.0e-9;
+    m_frameTime = (float)m_frameDelta;
 
     if (m_audioOutput && m_audioOutput->usingThead() == false)
         m_audioOutput->tick(); // Manual tick
 
-    update(m_frameTime);
+    if (m_fixedTimeStep > 0.0) {
+        runFixedSteps();
+    }
+    else {
+        GE_PROFILE_ZONE("GameWindow::update");
+        updateFrame(m_frameDelta);
+        m_interpolationAlpha = 1.0;
+    }
 
     if (m_audioOutput && m_audioOutput->usingThead() == false)
         m_audioOutput->tick(); // Manual tick
 
-    onRender();
+    // Delete the audio sources which finished since the previous frame.
+    m_audioMixer.reclaimFinishedSources();
+
+    const qint64 renderStart(getTickCountNs());
 
-    if (!eglSwapBuffers(eglDisplay, eglSurface)) {
+    {
+        GE_PROFILE_ZONE("GameWindow::onRender");
+        onRenderInterpolated(m_interpolationAlpha);
+    }
+
+    const qint64 swapStart(getTickCountNs());
+    EGLBoolean swapped(EGL_FALSE);
+
+    {
+        GE_PROFILE_ZONE("eglSwapBuffers");
+        swapped = eglSwapBuffers(eglDisplay, eglSurface);
+    }
+
+    if (!swapped) {
         // eglSwapBuffers() failed!
         GLint errVal = eglGetError();
 
@@ -714,11 +931,18 @@ void GameWindow::render()
                                                 getWindow(),
                                                 NULL);
             eglMakeCurrent(eglDisplay, eglSurface, eglSurface, eglContext);
+            applySwapInterval();
         }
         else {
             cleanupAndExit(eglDisplay);
         }
     }
+
+    m_frameStatistics.addFrame(renderStart - m_currentTime,
+                               swapStart - renderStart,
+                               getTickCountNs() - swapStart,
+                               m_currentTime - m_prevTime);
+    m_fps = (float)m_frameStatistics.frameRate();
 }
 
 
@@ -21,6 +21,7 @@
 #include "audiomixer.h"
 #include "audioout.h"
 #include "audiosourceif.h"
+#include "framestatistics.h"
 
 #ifdef Q_OS_SYMBIAN
 // For volume keys
@@ -39,6 +40,11 @@ class CRepository;
 
 namespace GE {
 
+// Constants
+const int GEDefaultMaxCatchUpSteps(5); // Fixed steps per frame at most
+const int GEDefaultSwapInterval(1); // The EGL default, sync to each vsync
+
+
 class GameWindow : public QWidget
 #ifdef Q_OS_SYMBIAN
                   ,public MRemConCoreApiTargetObserver
@@ -57,14 +63,30 @@ public:
     bool isProfileSilent() const;
     inline bool audioEnabled() { return m_audioEnabled; }
     AudioMixer &getMixer() { return m_audioMixer; }
+    AudioOut *getAudioOutput() const { return m_audioOutput; }
     void setHdOutput(bool onOff);
     inline bool hdEnabled() const { return m_hdEnabled; }
     inline bool hdConnected() const { return m_hdConnected; }
+    void setFixedTimeStep(double step,
+                          int maxCatchUpSteps = GEDefaultMaxCatchUpSteps);
+    void setSwapInterval(int interval);
+    void setTargetFrameRate(int framesPerSecond);
 
 public: // Helpers/getters
+    static qint64 getTickCountNs();
     unsigned int getTickCount() const;
+    double getFrameDelta() const { return m_frameDelta; }
     float getFrameTime() const { return m_frameTime; }
     float getFPS() const { return m_fps; }
+    double getFixedTimeStep() const { return m_fixedTimeStep; }
+    int getMaxCatchUpSteps() const { return m_maxCatchUpSteps; }
+    double getInterpolationAlpha() const { return m_interpolationAlpha; }
+    int getDroppedStepCount() const { return m_droppedStepCount; }
+    int getSwapInterval() const { return m_swapInterval; }
+    int getTargetFrameRate() const { return m_targetFrameRate; }
+    int getMissedDeadlineCount() const { return m_missedDeadlineCount; }
+    const FrameStatistics &getFrameStatistics() const
+        { return m_frameStatistics; }
     int width();
     int height();
 
@@ -86,11 +108,13 @@ protected: // Application callbacks, override these in your own derived class
     virtual void onFreeEGL();
     virtual void onDestroy();
     virtual void onRender();
+    virtual void onRenderInterpolated(const double alpha);
     virtual void onPause();
     virtual void onResume();
     virtual void onVolumeUp();
     virtual void onVolumeDown();
 
+    virtual void updateFrame(const double frameDelta);
     virtual void update(const float frameDelta);
     virtual void setSize(int width, int height);
 
@@ -98,6 +122,9 @@ protected: // For internal functionality
     virtual void createEGL();
     void reinitEGL();
     void render();
+    void runFixedSteps();
+    void applySwapInterval();
+    void scheduleNextFrame();
     bool testEGLError(const char* pszLocation);
     void cleanupAndExit(EGLDisplay eglDisplay);
     virtual EGLNativeWindowType getWindow();
@@ -127,10 +154,26 @@ protected: // Data
     EGLContext eglContext;
 
     // Time calculation
-    unsigned int m_prevTime;
-    unsigned int m_currentTime;
-    float m_frameTime;
-    float m_fps;
+    qint64 m_prevTime; // In nanoseconds, see getTickCountNs()
+    qint64 m_currentTime; // In nanoseconds
+    double m_frameDelta; // In seconds
+    float m_frameTime; // m_frameDelta for compatibility
+    float m_fps; // Averaged over m_frameStatistics
+    FrameStatistics m_frameStatistics;
+
+    // Fixed timestep, see setFixedTimeStep()
+    double m_fixedTimeStep; // In seconds, 0 if not used
+    int m_maxCatchUpSteps;
+    double m_accumulator; // The simulation time not yet stepped
+    double m_interpolationAlpha;
+    int m_droppedStepCount;
+
+    // Frame pacing, see setTargetFrameRate()
+    int m_swapInterval;
+    int m_targetFrameRate; // 0 if not limited
+    qint64 m_frameDeadline; // In nanoseconds, when to render the next frame
+    int m_missedDeadlineCount;
+
     bool m_paused;
     int m_timerId;
 
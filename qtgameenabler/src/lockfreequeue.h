@@ -0,0 +1,177 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#ifndef GELOCKFREEQUEUE_H
+#define GELOCKFREEQUEUE_H
+
+#include <QAtomicInt>
+
+
+namespace GE {
+
+/*!
+  \class MpscQueue
+  \brief A bounded lock-free queue with any number of producer threads and a
+         single consumer thread.
+
+  Neither push() nor pop() ever blocks or allocates memory: push() fails
+  when the queue is full and pop() fails when the queue is empty.
+  \a Capacity must be a power of two.
+*/
+template <typename T, int Capacity>
+class MpscQueue
+{
+public:
+    MpscQueue()
+        : m_enqueuePos(0),
+          m_dequeuePos(0)
+    {
+        for (int i = 0; i < Capacity; i++)
+            m_cells[i].sequence = i;
+    }
+
+public:
+    /*!
+      Adds \a value to the end of the queue. Can be called from any thread.
+      Returns false if the queue is full.
+    */
+    bool push(const T &value)
+    {
+        Cell *cell(0);
+        int pos(m_enqueuePos);
+
+        while (1) {
+            cell = &m_cells[pos & (Capacity - 1)];
+            const unsigned int sequence(cell->sequence.fetchAndAddAcquire(0));
+            const int dif((int)(sequence - (unsigned int)pos));
+
+            if (dif == 0) {
+                // The cell is free, try to reserve it.
+                if (m_enqueuePos.testAndSetRelaxed(pos, pos + 1))
+                    break;
+            }
+            else if (dif < 0) {
+                // The consumer has not released the cell yet, the queue is
+                // full.
+                return false;
+            }
+
+            // Another producer got the cell, try again.
+            pos = m_enqueuePos;
+        }
+
+        cell->value = value;
+        cell->sequence.fetchAndStoreRelease(pos + 1);
+        return true;
+    }
+
+    /*!
+      Takes the first item of the queue into \a value. Must be called from
+      the consumer thread only. Returns false if the queue is empty.
+    */
+    bool pop(T &value)
+    {
+        Cell *cell = &m_cells[m_dequeuePos & (Capacity - 1)];
+        const unsigned int sequence(cell->sequence.fetchAndAddAcquire(0));
+        const int dif((int)(sequence - (m_dequeuePos + 1)));
+
+        if (dif < 0) {
+            // Nothing has been published to the cell yet.
+            return false;
+        }
+
+        value = cell->value;
+        cell->sequence.fetchAndStoreRelease((int)(m_dequeuePos + Capacity));
+        m_dequeuePos++;
+        return true;
+    }
+
+private: // Data types
+    struct Cell {
+        QAtomicInt sequence;
+        T value;
+    };
+
+private: // Data
+    Cell m_cells[Capacity];
+    QAtomicInt m_enqueuePos;
+    unsigned int m_dequeuePos; // Accessed by the consumer only
+};
+
+
+/*!
+  \class SpscQueue
+  \brief A bounded lock-free queue with a single producer thread and a
+         single consumer thread.
+
+  Cheaper than MpscQueue since no compare-and-swap is needed. Neither push()
+  nor pop() ever blocks or allocates memory. \a Capacity must be a power of
+  two.
+*/
+template <typename T, int Capacity>
+class SpscQueue
+{
+public:
+    SpscQueue()
+        : m_head(0),
+          m_tail(0)
+    {
+    }
+
+public:
+    /*!
+      Adds \a value to the end of the queue. Must be called from the
+      producer thread only. Returns false if the queue is full.
+    */
+    bool push(const T &value)
+    {
+        const unsigned int tail(m_tail);
+        const unsigned int head(m_head.fetchAndAddAcquire(0));
+
+        if (tail - head >= (unsigned int)Capacity)
+            return false;
+
+        m_items[tail & (Capacity - 1)] = value;
+        m_tail.fetchAndStoreRelease((int)(tail + 1));
+        return true;
+    }
+
+    /*!
+      Takes the first item of the queue into \a value. Must be called from
+      the consumer thread only. Returns false if the queue is empty.
+    */
+    bool pop(T &value)
+    {
+        const unsigned int head(m_head);
+        const unsigned int tail(m_tail.fetchAndAddAcquire(0));
+
+        if (head == tail)
+            return false;
+
+        value = m_items[head & (Capacity - 1)];
+        m_head.fetchAndStoreRelease((int)(head + 1));
+        return true;
+    }
+
+    /*!
+      Returns the number of items in the queue. The value is exact only when
+      called from the producer or the consumer thread while the other side
+      is idle.
+    */
+    int count() const
+    {
+        return (int)((unsigned int)(int)m_tail - (unsigned int)(int)m_head);
+    }
+
+private: // Data
+    T m_items[Capacity];
+    QAtomicInt m_head; // Written by the consumer only
+    QAtomicInt m_tail; // Written by the producer only
+};
+
+} // namespace GE
+
+#endif // GELOCKFREEQUEUE_H
@@ -0,0 +1,317 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#include "profiler.h"
+#include <QFile>
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <QThreadStorage>
+#include "clock.h"
+#include "trace.h" // For debug macros
+
+using namespace GE;
+
+
+namespace {
+
+// Owned by QThreadStorage, deleted when the thread finishes.
+struct ThreadEntry {
+    ProfileBuffer *buffer; // Not owned, kept after the thread finishes
+};
+
+
+struct ProfileRegistry {
+    ~ProfileRegistry() { qDeleteAll(buffers); }
+
+    QMutex mutex; // Guards the list and the thread names
+    QList<ProfileBuffer*> buffers; // Owned
+    QThreadStorage<ThreadEntry*> threads;
+};
+
+Q_GLOBAL_STATIC(ProfileRegistry, profileRegistry)
+
+QAtomicInt profilerEnabled(1);
+
+
+/*!
+  Appends \a string to \a json as a JSON string.
+*/
+void appendJsonString(QByteArray &json, const QByteArray &string)
+{
+    const char hex[] = "0123456789abcdef";
+
+    json.append('"');
+
+    for (int i = 0; i < string.size(); i++) {
+        const char c(string.constData()[i]);
+
+        if (c == '"' || c == '\\') {
+            json.append('\\');
+            json.append(c);
+        }
+        else if ((unsigned char)c < 0x20) {
+            json.append("\\u00", 4);
+            json.append(hex[(c >> 4) & 15]);
+            json.append(hex[c & 15]);
+        }
+        else {
+            json.append(c);
+        }
+    }
+
+    json.append('"');
+}
+
+} // namespace
+
+
+/*!
+  \class ProfileBuffer
+  \brief The zones recorded by a single thread.
+
+  Only the thread of the buffer adds zones, so adding takes no locks. The
+  zones are kept in a SnapshotRing which overwrites the oldest zones when
+  full, so the buffer always holds the latest GEProfileBufferCapacity
+  zones. The zones can be read from any thread with events().
+*/
+
+
+/*!
+  Constructor.
+*/
+ProfileBuffer::ProfileBuffer(int threadId, const QString &threadName)
+    : m_events(GEProfileBufferCapacity),
+      m_threadId(threadId),
+      m_threadName(threadName)
+{
+}
+
+
+/*!
+  Destructor.
+*/
+ProfileBuffer::~ProfileBuffer()
+{
+}
+
+
+/*!
+  \class Profiler
+  \brief A low-overhead CPU profiler of scoped zones.
+
+  The zones are marked with GE_PROFILE_ZONE(name), which records the time
+  from the macro to the end of the enclosing scope. Each thread records into
+  its own ProfileBuffer, created on the first zone, so recording takes no
+  locks; a zone costs two reads of the clock and a few stores. The macros
+  expand to nothing unless GE_PROFILE is defined, see qtgameenabler.pri.
+
+  chromeTrace() returns the latest zones of all the threads in the Trace
+  Event format, which can be opened in chrome://tracing to view the threads
+  on a common timeline. Name the threads with GE_PROFILE_THREAD(name).
+*/
+
+
+/*!
+  Returns the current time for the zones in nanoseconds, see
+  Clock::tickCountNs().
+*/
+qint64 Profiler::timestampNs()
+{
+    return Clock::tickCountNs();
+}
+
+
+/*!
+  Returns the buffer of the calling thread, creating it if necessary, or
+  NULL if the profiler is disabled.
+*/
+ProfileBuffer *Profiler::threadBuffer()
+{
+    if (!(int)profilerEnabled)
+        return 0;
+
+    ThreadEntry *entry = profileRegistry()->threads.localData();
+
+    if (entry)
+        return entry->buffer;
+
+    return createThreadBuffer();
+}
+
+
+/*!
+  Names the calling thread \a name in the trace. By default the object name
+  of the QThread is used, if set.
+*/
+void Profiler::setThreadName(const QString &name)
+{
+    ProfileRegistry *registry = profileRegistry();
+    ThreadEntry *entry = registry->threads.localData();
+    ProfileBuffer *buffer = entry ? entry->buffer : createThreadBuffer();
+
+    QMutexLocker locker(&registry->mutex);
+    Q_UNUSED(locker); // To prevent warnings
+    buffer->setThreadName(name);
+}
+
+
+/*!
+  Enables the recording of the zones if \a enabled is true, disables it
+  otherwise. Enabled by default. The zones started before disabling are
+  still recorded.
+*/
+void Profiler::setEnabled(bool enabled)
+{
+    profilerEnabled.fetchAndStoreOrdered(enabled ? 1 : 0);
+}
+
+
+/*!
+  Returns true if the zones are recorded, false otherwise.
+*/
+bool Profiler::isEnabled()
+{
+    return (int)profilerEnabled != 0;
+}
+
+
+/*!
+  Drops the zones recorded by all the threads. The recording should be
+  disabled while clearing, otherwise a zone ending at the same time in
+  another thread may restore some of the dropped zones.
+*/
+void Profiler::clear()
+{
+    ProfileRegistry *registry = profileRegistry();
+    QMutexLocker locker(&registry->mutex);
+    Q_UNUSED(locker); // To prevent warnings
+
+    for (int i = 0; i < registry->buffers.count(); i++)
+        registry->buffers[i]->clear();
+}
+
+
+/*!
+  Returns the zones in the buffers of all the threads, that is the latest
+  GEProfileBufferCapacity zones of each thread, as a JSON document in the
+  Trace Event format. The times are in microseconds from the start of the
+  earliest zone. Can be called from any thread while recording.
+*/
+QByteArray Profiler::chromeTrace()
+{
+    ProfileRegistry *registry = profileRegistry();
+    QMutexLocker locker(&registry->mutex);
+    Q_UNUSED(locker); // To prevent warnings
+
+    const int buffers(registry->buffers.count());
+    QList<QVector<ProfileBuffer::Event> > events;
+    qint64 origin(0);
+    bool first(true);
+
+    for (int i = 0; i < buffers; i++) {
+        const ProfileBuffer *buffer = registry->buffers[i];
+        const int written(buffer->written());
+        events.append(buffer->events());
+        const QVector<ProfileBuffer::Event> &zones = events.last();
+
+        // The zones are in the order they ended, not started.
+        for (int j = 0; j < zones.count(); j++) {
+            if (first || zones[j].start < origin) {
+                origin = zones[j].start;
+                first = false;
+            }
+        }
+
+        if (written > zones.count()) {
+            DEBUG_INFO(buffer->threadName() << "overwrote" <<
+                       written - zones.count() << "zones");
+        }
+    }
+
+    QByteArray json("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    for (int i = 0; i < buffers; i++) {
+        const ProfileBuffer *buffer = registry->buffers[i];
+        const QByteArray tid(QByteArray::number(buffer->threadId()));
+
+        if (i > 0)
+            json.append(",\n", 2);
+
+        json.append("{\"name\":\"thread_name\",\"ph\":\"M\",");
+        json.append("\"pid\":1,\"tid\":");
+        json.append(tid);
+        json.append(",\"args\":{\"name\":");
+        appendJsonString(json, buffer->threadName().toUtf8());
+        json.append("}}");
+
+        for (int j = 0; j < events[i].count(); j++) {
+            const ProfileBuffer::Event &event = events[i][j];
+
+            json.append(",\n{\"name\":");
+            appendJsonString(json, QByteArray(event.name));
+            json.append(",\"cat\":\"GE\",\"ph\":\"X\",\"pid\":1,\"tid\":");
+            json.append(tid);
+            json.append(",\"ts\":");
+            json.append(QByteArray::number(
+                (double)(event.start - origin) * 1.0e-3, 'f', 3));
+            json.append(",\"dur\":");
+            json.append(QByteArray::number(
+                (double)(event.end - event.start) * 1.0e-3, 'f', 3));
+            json.append('}');
+        }
+    }
+
+    json.append("\n]}\n");
+    return json;
+}
+
+
+/*!
+  Writes chromeTrace() into the file \a fileName. Returns true if
+  successful, false otherwise.
+*/
+bool Profiler::writeChromeTrace(const QString &fileName)
+{
+    QFile file(fileName);
+
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        DEBUG_INFO("Failed to open" << fileName);
+        return false;
+    }
+
+    const QByteArray json(chromeTrace());
+    return (file.write(json) == json.size());
+}
+
+
+/*!
+  Creates and registers the buffer of the calling thread. Returns the
+  buffer.
+*/
+ProfileBuffer *Profiler::createThreadBuffer()
+{
+    ProfileRegistry *registry = profileRegistry();
+    QThread *thread = QThread::currentThread();
+    QString name(thread ? thread->objectName() : QString());
+
+    QMutexLocker locker(&registry->mutex);
+    Q_UNUSED(locker); // To prevent warnings
+
+    const int threadId(registry->buffers.count() + 1);
+
+    if (name.isEmpty())
+        name = QString("Thread %1").arg(threadId);
+
+    ProfileBuffer *buffer = new ProfileBuffer(threadId, name);
+    registry->buffers.append(buffer);
+
+    ThreadEntry *entry = new ThreadEntry;
+    entry->buffer = buffer;
+    registry->threads.setLocalData(entry);
+    return buffer;
+}
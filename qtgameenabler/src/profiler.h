@@ -0,0 +1,134 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#ifndef GEPROFILER_H
+#define GEPROFILER_H
+
+#include <QByteArray>
+#include <QString>
+#include <QVector>
+#include "snapshotring.h"
+
+
+namespace GE {
+
+// Constants
+const int GEProfileBufferCapacity(16384); // Zones per thread, power of two
+
+
+class ProfileBuffer
+{
+public: // Data types
+
+    struct Event {
+        const char *name; // Not owned, must stay valid
+        qint64 start; // In nanoseconds, see Profiler::timestampNs()
+        qint64 end;
+    };
+
+public:
+    ProfileBuffer(int threadId, const QString &threadName);
+    ~ProfileBuffer();
+
+public:
+    /*!
+      Adds the zone \a name lasting from \a start to \a end, replacing the
+      oldest zone if the buffer is full. To be called by the thread of the
+      buffer only.
+    */
+    inline void add(const char *name, qint64 start, qint64 end)
+    {
+        Event &event = m_events.next();
+        event.name = name;
+        event.start = start;
+        event.end = end;
+        m_events.publish();
+    }
+
+    inline int threadId() const { return m_threadId; }
+    inline QString threadName() const { return m_threadName; }
+    inline void setThreadName(const QString &name) { m_threadName = name; }
+    inline int written() const { return m_events.written(); }
+    inline QVector<Event> events() const { return m_events.snapshot(); }
+    inline void clear() { m_events.clear(); }
+
+protected: // Data
+    SnapshotRing<Event> m_events;
+    int m_threadId;
+    QString m_threadName;
+
+private:
+    Q_DISABLE_COPY(ProfileBuffer)
+};
+
+
+class Profiler
+{
+public:
+    static qint64 timestampNs();
+    static ProfileBuffer *threadBuffer();
+    static void setThreadName(const QString &name);
+
+    static void setEnabled(bool enabled);
+    static bool isEnabled();
+    static void clear();
+
+    static QByteArray chromeTrace();
+    static bool writeChromeTrace(const QString &fileName);
+
+protected:
+    static ProfileBuffer *createThreadBuffer();
+};
+
+
+class ProfileZone
+{
+public:
+    /*!
+      Starts the zone \a name, which must stay valid, for example a string
+      literal. Does nothing if the profiler is disabled.
+    */
+    inline explicit ProfileZone(const char *name)
+        : m_name(name),
+          m_buffer(Profiler::threadBuffer()),
+          m_start(m_buffer ? Profiler::timestampNs() : 0)
+    {
+    }
+
+    /*!
+      Ends the zone.
+    */
+    inline ~ProfileZone()
+    {
+        if (m_buffer)
+            m_buffer->add(m_name, m_start, Profiler::timestampNs());
+    }
+
+protected: // Data
+    const char *m_name;
+    ProfileBuffer *m_buffer; // Not owned, NULL if not recording
+    qint64 m_start;
+
+private:
+    Q_DISABLE_COPY(ProfileZone)
+};
+
+} // namespace GE
+
+
+#define GE_PROFILE_CONCAT_(A, B) A##B
+#define GE_PROFILE_CONCAT(A, B) GE_PROFILE_CONCAT_(A, B)
+
+#ifdef GE_PROFILE
+    #define GE_PROFILE_ZONE(NAME) \
+        GE::ProfileZone GE_PROFILE_CONCAT(geProfileZone, __LINE__)(NAME)
+    #define GE_PROFILE_THREAD(NAME) GE::Profiler::setThreadName(NAME)
+#else
+    #define GE_PROFILE_ZONE(NAME) do {} while (0)
+    #define GE_PROFILE_THREAD(NAME) do {} while (0)
+#endif
+
+#endif // GEPROFILER_H
@@ -0,0 +1,132 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#ifndef GESNAPSHOTRING_H
+#define GESNAPSHOTRING_H
+
+#include <QAtomicInt>
+#include <QVector>
+
+
+namespace GE {
+
+/*!
+  \class SnapshotRing
+  \brief A ring of the latest items added by a single writer thread, which
+         can be copied from any thread.
+
+  Adding an item never blocks nor allocates memory; when the ring is full
+  the oldest item is overwritten. snapshot() copies the items without
+  locking and skips the ones overwritten while it was copying. The capacity
+  is a power of two.
+*/
+template <typename T>
+class SnapshotRing
+{
+public:
+    /*!
+      Constructor. The capacity is \a minimumCapacity items rounded up to
+      the next power of two.
+    */
+    explicit SnapshotRing(int minimumCapacity)
+        : m_items(0),
+          m_capacity(2),
+          m_written(0)
+    {
+        while (m_capacity < minimumCapacity)
+            m_capacity <<= 1;
+
+        m_items = new T[m_capacity];
+    }
+
+    ~SnapshotRing()
+    {
+        delete [] m_items;
+    }
+
+public:
+    inline int capacity() const { return m_capacity; }
+
+    /*!
+      Returns the number of items added since the ring was cleared,
+      including the overwritten ones.
+    */
+    inline int written() const
+    {
+        return m_written.fetchAndAddAcquire(0);
+    }
+
+    /*!
+      Returns the slot of the next item, which still holds the oldest item
+      if the ring is full. To be filled by the writer thread only, the item
+      becomes visible to the readers with publish().
+    */
+    inline T &next()
+    {
+        return m_items[(int)m_written & (m_capacity - 1)];
+    }
+
+    /*!
+      Publishes the item filled in next(). To be called by the writer thread
+      only.
+    */
+    inline void publish()
+    {
+        m_written.fetchAndStoreRelease((int)m_written + 1);
+    }
+
+    /*!
+      Drops all the items. A snapshot() being taken at the same time returns
+      no items.
+    */
+    void clear()
+    {
+        m_written.fetchAndStoreRelease(0);
+    }
+
+    /*!
+      Returns a copy of the items in the ring, the oldest first. Can be
+      called from any thread while the items are being added.
+    */
+    QVector<T> snapshot() const
+    {
+        const int end(m_written.fetchAndAddAcquire(0));
+        const int count((int)qMin((unsigned int)end,
+                                  (unsigned int)m_capacity));
+        QVector<T> items;
+        items.resize(count);
+
+        for (int i = 0; i < count; i++)
+            items[i] = m_items[(end - count + i) & (m_capacity - 1)];
+
+        // Drop the items overwritten while copying, including the one which
+        // may be being written.
+        const int written(m_written.fetchAndAddAcquire(0));
+
+        if ((unsigned int)written < (unsigned int)end)
+            return QVector<T>(); // Cleared while copying
+
+        const int overwritten((int)((unsigned int)written - (unsigned int)end) -
+                              (m_capacity - count) + 1);
+
+        if (overwritten > 0)
+            items.remove(0, qMin(overwritten, count));
+
+        return items;
+    }
+
+private: // Data
+    T *m_items; // Owned
+    int m_capacity; // In items, a power of two
+    mutable QAtomicInt m_written; // Items added, by the writer only
+
+private:
+    Q_DISABLE_COPY(SnapshotRing)
+};
+
+} // namespace GE
+
+#endif // GESNAPSHOTRING_H
@@ -0,0 +1,644 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#include "streamingaudiosource.h"
+#include <QByteArray>
+#include <QFile>
+#include <QIODevice>
+#include <QThread>
+#include <QVector>
+#include <memory.h>
+#include "audioconfig.h"
+#include "audioconvert.h"
+#include "audioringbuffer.h"
+#include "trace.h" // For debug macros
+#include "wavparser.h"
+
+using namespace GE;
+
+// Constants
+const int GEStreamDecodeFrames(4096); // Frames read from the device at once
+const int GEMinStreamWindowLength(20); // In milliseconds
+
+
+namespace GE {
+
+/*!
+  \class WavStreamDecoder
+  \brief Decodes the PCM data of a .wav file incrementally into interleaved
+         stereo samples at the mixing rate.
+
+  Used as the source when filling the window of a StreamingAudioSource. The
+  decoder is used by one thread at a time only.
+*/
+class WavStreamDecoder : public AudioSource
+{
+public:
+    explicit WavStreamDecoder(QIODevice *device);
+
+public:
+    bool readHeader();
+    bool restart(int loopCount);
+
+public: // From AudioSource
+    int pullAudio(AUDIO_SAMPLE_TYPE *target, int bufferLength);
+
+protected:
+    bool decodeMore();
+
+protected: // Data
+    QIODevice *m_device; // Not owned
+    QByteArray m_raw;
+    QVector<AUDIO_SAMPLE_TYPE> m_frames; // Decoded, not yet resampled
+    int m_frameCount;
+    qint64 m_dataOffset;
+    qint64 m_dataLength;
+    qint64 m_dataPos;
+    int m_nofChannels;
+    int m_bitsPerSample;
+    int m_samplesPerSec;
+    int m_frameSize;
+    bool m_narrow; // 24 or 32-bit integer PCM, narrowed to 16 bits
+    int m_loopCount;
+    qint64 m_fixedPos; // 16.16, relative to the first frame in m_frames
+    qint64 m_fixedInc;
+};
+
+
+/*!
+  \class StreamingThread
+  \brief Keeps the window of a StreamingAudioSource filled.
+*/
+class StreamingThread : public QThread
+{
+public:
+    explicit StreamingThread(StreamingAudioSource *source)
+        : m_source(source),
+          m_run(0)
+    {
+    }
+
+public:
+    void startDecoding()
+    {
+        m_run = 1;
+        start();
+    }
+
+    void stopDecoding()
+    {
+        m_run = 0;
+        wait();
+    }
+
+protected: // From QThread
+    virtual void run()
+    {
+        // Poll four times per half of the window.
+        const int sleepTime(qMax(1, m_source->m_windowLength / 8));
+
+        while (m_run == 1) {
+            m_source->decodeAhead();
+            m_source->dispatchFinished();
+            msleep(sleepTime);
+        }
+    }
+
+protected: // Data
+    StreamingAudioSource *m_source; // Not owned
+    QAtomicInt m_run;
+};
+
+} // namespace GE
+
+
+/*!
+  Constructor. The decoder does not take the ownership of \a device.
+*/
+WavStreamDecoder::WavStreamDecoder(QIODevice *device)
+    : m_device(device),
+      m_frameCount(0),
+      m_dataOffset(0),
+      m_dataLength(0),
+      m_dataPos(0),
+      m_nofChannels(0),
+      m_bitsPerSample(0),
+      m_samplesPerSec(0),
+      m_frameSize(0),
+      m_narrow(false),
+      m_loopCount(0),
+      m_fixedPos(0),
+      m_fixedInc(1 << 16)
+{
+}
+
+
+/*!
+  Reads the format and the position of the data from the RIFF header of the
+  device. Returns true if successful, false if the format is not supported.
+*/
+bool WavStreamDecoder::readHeader()
+{
+    WavParser wav;
+
+    if (!wav.parse(m_device))
+        return false;
+
+    const bool pcm(wav.audioFormat() == GEWavFormatPcm ||
+                   wav.audioFormat() == GEWavFormatFloat);
+
+    if (!pcm || !wav.isSupported()) {
+        DEBUG_INFO("Unsupported format:" << wav.audioFormat() << ","
+                   << wav.bitsPerSample() << "bits,"
+                   << wav.nofChannels() << "channels.");
+        return false;
+    }
+
+    m_nofChannels = wav.nofChannels();
+    m_bitsPerSample = wav.bitsPerSample();
+    m_samplesPerSec = wav.samplesPerSec();
+    m_narrow = wav.needsNarrowing();
+    m_frameSize = m_nofChannels * m_bitsPerSample / 8;
+    m_dataOffset = wav.dataOffset();
+    m_dataLength = wav.dataLength();
+    m_dataLength -= m_dataLength % m_frameSize;
+    return (m_dataLength > 0);
+}
+
+
+/*!
+  Rewinds the decoder to the beginning of the data. If \a loopCount is -1,
+  the data is repeated forever. Returns true if successful, false otherwise.
+*/
+bool WavStreamDecoder::restart(int loopCount)
+{
+    m_loopCount = loopCount;
+    m_frameCount = 0;
+    m_fixedPos = 0;
+    m_fixedInc = ((qint64)m_samplesPerSec << 16) / AudioConfig::sampleRate();
+    m_dataPos = 0;
+    return m_device->seek(m_dataOffset);
+}
+
+
+/*!
+  From AudioSource.
+
+  Decodes and resamples \a bufferLength samples into \a target. Returns less
+  than requested only when the end of the last loop has been reached.
+*/
+int WavStreamDecoder::pullAudio(AUDIO_SAMPLE_TYPE *target, int bufferLength)
+{
+    const int frames(bufferLength / 2);
+    int produced(0);
+
+    while (produced < frames) {
+        const int index((int)(m_fixedPos >> 16));
+
+        if (index + 1 >= m_frameCount) {
+            // Keep the frames still needed for the interpolation. Across a
+            // loop point the last frame is interpolated with the first one,
+            // which keeps the loop gapless.
+            if (index > 0 && index < m_frameCount) {
+                memmove(m_frames.data(), m_frames.constData() + index * 2,
+                        sizeof(AUDIO_SAMPLE_TYPE) * (m_frameCount - index) * 2);
+            }
+
+            m_frameCount = qMax(0, m_frameCount - index);
+            m_fixedPos -= (qint64)index << 16;
+
+            if (!decodeMore())
+                break;
+
+            continue;
+        }
+
+        const AUDIO_SAMPLE_TYPE *source = m_frames.constData() + index * 2;
+        // 15 bits of the fraction are used so that the products fit an int.
+        const int frac((int)(m_fixedPos & 0xffff) >> 1);
+
+        target[0] = (AUDIO_SAMPLE_TYPE)
+            (source[0] + (((source[2] - source[0]) * frac) >> 15));
+        target[1] = (AUDIO_SAMPLE_TYPE)
+            (source[1] + (((source[3] - source[1]) * frac) >> 15));
+
+        target += 2;
+        m_fixedPos += m_fixedInc;
+        produced++;
+    }
+
+    return produced * 2;
+}
+
+
+/*!
+  Reads and converts the next part of the data into the decoded frames. At
+  the end of the data, rewinds to the beginning if there are loops left.
+  Returns false when there is no more data.
+*/
+bool WavStreamDecoder::decodeMore()
+{
+    if (m_dataPos >= m_dataLength) {
+        if (m_loopCount > 0)
+            m_loopCount--;
+
+        if (m_loopCount == 0 || !m_device->seek(m_dataOffset))
+            return false;
+
+        m_dataPos = 0;
+    }
+
+    const qint64 length(qMin(m_dataLength - m_dataPos,
+                             (qint64)GEStreamDecodeFrames * m_frameSize));
+    m_raw.resize((int)length);
+
+    const qint64 read(m_device->read(m_raw.data(), length));
+
+    if (read < m_frameSize) {
+        DEBUG_INFO("Failed to read the data!");
+        m_loopCount = 0;
+        m_dataPos = m_dataLength;
+        return false;
+    }
+
+    const int newFrames((int)(read / m_frameSize));
+
+    if (m_frames.size() < (m_frameCount + newFrames) * 2)
+        m_frames.resize((m_frameCount + newFrames) * 2);
+
+    int bitsPerSample(m_bitsPerSample);
+
+    if (m_narrow) {
+        // In place, the samples only get shorter.
+        AudioConverter::toPcm16(m_raw.constData(), newFrames * m_nofChannels,
+                                m_bitsPerSample,
+                                (AUDIO_SAMPLE_TYPE*)m_raw.data());
+        bitsPerSample = AUDIO_SAMPLE_BITS;
+    }
+
+    AudioConverter::toStereo(m_raw.constData(), newFrames, bitsPerSample,
+                             m_nofChannels, m_frames.data() + m_frameCount * 2);
+
+    m_frameCount += newFrames;
+    m_dataPos += (qint64)newFrames * m_frameSize;
+    return true;
+}
+
+
+/*!
+  \class StreamingAudioSource
+  \brief An AudioSource playing a .wav file straight from a QIODevice.
+
+  Unlike AudioBuffer, the file is never decoded into memory as a whole. A
+  background thread decodes it incrementally into a window of
+  windowLength() milliseconds, refilling one half of the window while the
+  other half is being mixed. The memory used is therefore independent of
+  the length of the file, which makes the class suited for long music
+  tracks. Looping is gapless since the decoder rewinds without flushing the
+  window.
+
+  The data is converted to the mixing format while decoding. The device must
+  be random access for looping.
+
+  pullAudio() takes no locks: the window is a single-producer/single-consumer
+  ring and the state and the volumes are atomic. play(), stop() and close()
+  wait for a block being mixed, if any, instead of the mixing waiting for
+  them. The finished() signal is emitted by the decoding thread, not the
+  audio thread.
+*/
+
+
+/*!
+  Constructor.
+*/
+StreamingAudioSource::StreamingAudioSource(QObject *parent /* = 0 */)
+    : AudioSource(parent),
+      m_file(0),
+      m_decoder(0),
+      m_window(0),
+      m_thread(0),
+      m_windowLength(GEDefaultStreamWindowLength),
+      m_state(Stopped),
+      m_pulling(0),
+      m_endOfStream(0),
+      m_finishedPending(0),
+      m_underrunCount(0),
+      m_fixedLeftVolume((int)GEMaxAudioVolumeValue),
+      m_fixedRightVolume((int)GEMaxAudioVolumeValue)
+{
+    m_thread = new StreamingThread(this);
+}
+
+
+/*!
+  Destructor.
+*/
+StreamingAudioSource::~StreamingAudioSource()
+{
+    close();
+    delete m_thread;
+}
+
+
+/*!
+  Opens the .wav file \a fileName for streaming. Returns true if successful,
+  false otherwise.
+*/
+bool StreamingAudioSource::open(const QString &fileName)
+{
+    close();
+
+    QFile *file = new QFile(fileName);
+
+    if (!file->open(QIODevice::ReadOnly)) {
+        DEBUG_INFO("Failed to open" << fileName);
+        delete file;
+        return false;
+    }
+
+    if (!open(file)) {
+        delete file;
+        return false;
+    }
+
+    m_file = file;
+    return true;
+}
+
+
+/*!
+  Opens a stream from \a device, which must be open and positioned at the
+  beginning of the .wav data. The ownership of the device is not
+  transferred, and it must not be used elsewhere while the source is open.
+  Returns true if successful, false otherwise.
+*/
+bool StreamingAudioSource::open(QIODevice *device)
+{
+    close();
+
+    if (!device || !device->isOpen())
+        return false;
+
+    WavStreamDecoder *decoder = new WavStreamDecoder(device);
+
+    if (!decoder->readHeader()) {
+        delete decoder;
+        return false;
+    }
+
+    m_decoder = decoder;
+    m_window = new AudioRingBuffer((int)((qint64)AudioConfig::sampleRate() *
+        AudioConfig::channelCount() * m_windowLength / 1000));
+
+    return true;
+}
+
+
+/*!
+  Stops the playback and closes the stream.
+*/
+void StreamingAudioSource::close()
+{
+    stop();
+
+    m_state.fetchAndStoreOrdered(Stopped);
+    waitForConsumer();
+
+    delete m_window;
+    m_window = 0;
+    delete m_decoder;
+    m_decoder = 0;
+    delete m_file;
+    m_file = 0;
+}
+
+
+/*!
+  Returns true if a stream is open, false otherwise.
+*/
+bool StreamingAudioSource::isOpen() const
+{
+    return (m_decoder != 0);
+}
+
+
+/*!
+  Sets the length of the decoded window to \a milliseconds. Takes effect the
+  next time a stream is opened.
+*/
+void StreamingAudioSource::setWindowLength(int milliseconds)
+{
+    m_windowLength = qMax(GEMinStreamWindowLength, milliseconds);
+}
+
+
+/*!
+  Returns true if the stream is playing, false otherwise.
+*/
+bool StreamingAudioSource::isPlaying() const
+{
+    return (m_state == Playing);
+}
+
+
+/*!
+  Returns true if the stream has played to the end, false otherwise.
+*/
+bool StreamingAudioSource::isFinished() const
+{
+    return (m_state == Finished);
+}
+
+
+/*!
+  Returns the number of times the mixing has run out of decoded data.
+*/
+int StreamingAudioSource::underrunCount() const
+{
+    return m_underrunCount;
+}
+
+
+/*!
+  Sets the volume of the left channel to \a volume.
+*/
+void StreamingAudioSource::setLeftVolume(float volume)
+{
+    m_fixedLeftVolume = (int)(GEMaxAudioVolumeValue * volume);
+}
+
+
+/*!
+  Sets the volume of the right channel to \a volume.
+*/
+void StreamingAudioSource::setRightVolume(float volume)
+{
+    m_fixedRightVolume = (int)(GEMaxAudioVolumeValue * volume);
+}
+
+
+/*!
+  From AudioSource.
+
+  Returns the louder channel volume while playing, 0 otherwise.
+*/
+int StreamingAudioSource::audibleVolume() const
+{
+    if (m_state != Playing)
+        return 0;
+
+    return qMax((int)m_fixedLeftVolume, (int)m_fixedRightVolume);
+}
+
+
+/*!
+  From AudioSource.
+
+  Copies the decoded samples from the window into \a target applying the
+  volume. Never blocks. Once the window has been drained after the end of
+  the stream, the state changes to finished and the decoding thread emits
+  finished().
+*/
+int StreamingAudioSource::pullAudio(AUDIO_SAMPLE_TYPE *target,
+                                    int bufferLength)
+{
+    // Announce the reading before checking the state, see waitForConsumer().
+    m_pulling.fetchAndStoreOrdered(1);
+
+    if (m_state.fetchAndAddOrdered(0) != Playing) {
+        m_pulling.fetchAndStoreRelease(0);
+        return 0;
+    }
+
+    // Read the end of stream flag first so that no samples written before
+    // it was set are missed.
+    const bool endOfStream(m_endOfStream.fetchAndAddAcquire(0) != 0);
+    const int length(m_window->read(target, bufferLength));
+    const int leftVolume(m_fixedLeftVolume);
+    const int rightVolume(m_fixedRightVolume);
+
+    if (leftVolume != (int)GEMaxAudioVolumeValue ||
+        rightVolume != (int)GEMaxAudioVolumeValue) {
+        AUDIO_SAMPLE_TYPE *t_target = target + length;
+
+        while (target < t_target) {
+            target[0] = ((target[0] * leftVolume) >> 12);
+            target[1] = ((target[1] * rightVolume) >> 12);
+            target += 2;
+        }
+    }
+
+    if (length < bufferLength) {
+        if (endOfStream) {
+            if (m_state.testAndSetOrdered(Playing, Finished))
+                m_finishedPending.fetchAndStoreRelease(1);
+        }
+        else {
+            m_underrunCount.ref();
+        }
+    }
+
+    m_pulling.fetchAndStoreRelease(0);
+    return length;
+}
+
+
+/*!
+  Starts playing the stream from the beginning. If \a loopCount is -1, the
+  stream will be repeated forever.
+*/
+void StreamingAudioSource::play(int loopCount /* = 0 */)
+{
+    stopThread();
+
+    m_state.fetchAndStoreOrdered(Stopped);
+    waitForConsumer();
+
+    if (!m_decoder)
+        return;
+
+    // Neither the decoding thread nor the mixing accesses the window now.
+    m_window->clear();
+    m_endOfStream = 0;
+    m_finishedPending = 0;
+
+    if (!m_decoder->restart(loopCount)) {
+        DEBUG_INFO("Failed to rewind the stream!");
+        return;
+    }
+
+    // Fill the whole window before starting so that the first blocks do not
+    // have to wait for the thread.
+    decodeAhead();
+    m_state.fetchAndStoreRelease(Playing);
+    m_thread->startDecoding();
+}
+
+
+/*!
+  Stops the playback.
+*/
+void StreamingAudioSource::stop()
+{
+    stopThread();
+    m_state.testAndSetOrdered(Playing, Stopped);
+}
+
+
+/*!
+  Called from the decoding thread. Refills the window once at least half of
+  it has been consumed.
+*/
+void StreamingAudioSource::decodeAhead()
+{
+    if (m_endOfStream != 0)
+        return;
+
+    const int free(m_window->capacity() - m_window->count());
+
+    if (free < m_window->capacity() / 2)
+        return;
+
+    if (m_window->fill(m_decoder, free, false) < free)
+        m_endOfStream.fetchAndStoreRelease(1);
+}
+
+
+/*!
+  Stops the decoding thread if it is running.
+*/
+void StreamingAudioSource::stopThread()
+{
+    if (m_thread->isRunning())
+        m_thread->stopDecoding();
+
+    // Deliver a notification the thread did not get to.
+    dispatchFinished();
+}
+
+
+/*!
+  Waits until pullAudio() is not reading the window. The state must have
+  been changed from Playing before calling, after which pullAudio() does not
+  start reading again. The wait lasts for one block being mixed at most.
+*/
+void StreamingAudioSource::waitForConsumer()
+{
+    while (m_pulling.fetchAndAddOrdered(0) != 0)
+        QThread::yieldCurrentThread();
+}
+
+
+/*!
+  Emits finished() if pullAudio() has drained the window after the end of
+  the stream since the previous call. Called from the decoding thread, or
+  from the thread of the source once the decoding thread has stopped.
+*/
+void StreamingAudioSource::dispatchFinished()
+{
+    if (m_finishedPending.testAndSetOrdered(1, 0))
+        emit finished();
+}
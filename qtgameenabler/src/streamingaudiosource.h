@@ -0,0 +1,98 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#ifndef GESTREAMINGAUDIOSOURCE_H
+#define GESTREAMINGAUDIOSOURCE_H
+
+#include <QAtomicInt>
+#include <QString>
+#include "audiosourceif.h"
+
+// Forward declarations
+class QFile;
+class QIODevice;
+
+
+namespace GE {
+
+// Forward declarations (inside GE namespace)
+class AudioRingBuffer;
+class StreamingThread;
+class WavStreamDecoder;
+
+// Constants
+const int GEDefaultStreamWindowLength(500); // In milliseconds
+
+
+class StreamingAudioSource : public AudioSource
+{
+    Q_OBJECT
+
+public:
+    explicit StreamingAudioSource(QObject *parent = 0);
+    virtual ~StreamingAudioSource();
+
+public:
+    bool open(const QString &fileName);
+    bool open(QIODevice *device);
+    void close();
+    bool isOpen() const;
+
+    void setWindowLength(int milliseconds);
+    inline int windowLength() const { return m_windowLength; }
+
+    bool isPlaying() const;
+    bool isFinished() const;
+    int underrunCount() const;
+
+    void setLeftVolume(float volume);
+    void setRightVolume(float volume);
+
+public: // From AudioSource
+    int audibleVolume() const;
+    int pullAudio(AUDIO_SAMPLE_TYPE *target, int bufferLength);
+
+public slots:
+    void play(int loopCount = 0);
+    void stop();
+
+signals:
+    void finished();
+
+protected: // Data types
+
+    enum StreamState {
+        Stopped = 0,
+        Playing = 1,
+        Finished = 2
+    };
+
+protected:
+    void decodeAhead();
+    void stopThread();
+    void waitForConsumer();
+    void dispatchFinished();
+
+protected: // Data
+    QFile *m_file; // Owned
+    WavStreamDecoder *m_decoder; // Owned
+    AudioRingBuffer *m_window; // Owned
+    StreamingThread *m_thread; // Owned
+    int m_windowLength;
+    QAtomicInt m_state; // The window is read only while Playing
+    QAtomicInt m_pulling; // 1 while pullAudio() may be reading the window
+    QAtomicInt m_endOfStream;
+    QAtomicInt m_finishedPending; // Set by the audio thread
+    QAtomicInt m_underrunCount;
+    QAtomicInt m_fixedLeftVolume;
+    QAtomicInt m_fixedRightVolume;
+
+    friend class StreamingThread;
+};
+
+} // namespace GE
+
+#endif // GESTREAMINGAUDIOSOURCE_H
@@ -0,0 +1,321 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#include "wavparser.h"
+#include <QByteArray>
+#include <QIODevice>
+#include <limits.h>
+#include <memory.h>
+#include "trace.h" // For debug macros
+
+using namespace GE;
+
+// Constants
+const int GEWavHeaderReadLength(4096); // Read from a device at once
+const int GEWavRiffHeaderLength(12);
+const int GEWavChunkHeaderLength(8);
+const int GEWavMinFormatLength(16);
+const int GEWavExtensibleFormatLength(40);
+const int GEWavMaxFormatLength(1024); // Sanity limit
+
+
+namespace {
+
+/*!
+  Reads little-endian values from unaligned \a data.
+*/
+inline quint16 readUint16(const char *data)
+{
+    const quint8 *bytes = (const quint8*)data;
+    return (quint16)(bytes[0] | (bytes[1] << 8));
+}
+
+inline quint32 readUint32(const char *data)
+{
+    const quint8 *bytes = (const quint8*)data;
+    return (quint32)bytes[0] | ((quint32)bytes[1] << 8) |
+        ((quint32)bytes[2] << 16) | ((quint32)bytes[3] << 24);
+}
+
+} // namespace
+
+
+/*!
+  \class WavParser
+  \brief Parses the RIFF header of a .wav file.
+
+  The chunks are walked by their sizes, so the chunks unknown to the parser
+  (LIST, cue and so on) can be anywhere before the data, and the fmt chunk
+  may have an extension. WAVE_FORMAT_EXTENSIBLE is resolved to its
+  subformat. Supported are 8, 16, 24 and 32-bit integer PCM, 32-bit float
+  and IMA ADPCM data with one or two channels.
+
+  The header is parsed from memory, for example from a mapped file, or from
+  a device with as few reads as possible: usually the whole header is read
+  at once. The data itself is not touched.
+*/
+
+
+/*!
+  Constructor.
+*/
+WavParser::WavParser()
+{
+    reset();
+}
+
+
+/*!
+  Parses the .wav file of \a length bytes in \a data. The data offset is
+  relative to \a data. Returns true if successful, false otherwise.
+*/
+bool WavParser::parse(const char *data, qint64 length)
+{
+    reset();
+
+    if (!data || !parseRiffHeader(data, length))
+        return false;
+
+    if (parseChunks(data + GEWavRiffHeaderLength,
+                    length - GEWavRiffHeaderLength,
+                    GEWavRiffHeaderLength) != ParseDone) {
+        return false;
+    }
+
+    return finish(length);
+}
+
+
+/*!
+  Parses the .wav file from \a device, which must be open, random access and
+  positioned at the beginning of the file. On success the device is left at
+  the beginning of the data and the data offset is the position in the
+  device. Returns true if successful, false otherwise.
+*/
+bool WavParser::parse(QIODevice *device)
+{
+    reset();
+
+    if (!device || !device->isOpen())
+        return false;
+
+    const qint64 start(device->pos());
+    QByteArray header(device->read(GEWavHeaderReadLength));
+
+    if (!parseRiffHeader(header.constData(), header.size()))
+        return false;
+
+    ParseResult result(parseChunks(header.constData() + GEWavRiffHeaderLength,
+                                   header.size() - GEWavRiffHeaderLength,
+                                   GEWavRiffHeaderLength));
+
+    while (result == ParseNeedMore) {
+        // A long chunk precedes the data, continue after it.
+        const qint64 offset(m_nextOffset);
+
+        if (!device->seek(start + offset))
+            return false;
+
+        header = device->read(GEWavHeaderReadLength);
+        result = parseChunks(header.constData(), header.size(), offset);
+
+        if (result == ParseNeedMore && m_nextOffset == offset) {
+            // Truncated, no progress.
+            return false;
+        }
+    }
+
+    if (result != ParseDone || !finish(device->size() - start))
+        return false;
+
+    m_dataOffset += start;
+    return device->seek(m_dataOffset);
+}
+
+
+/*!
+  Returns true if the format can be played by AudioBuffer, possibly after
+  narrowing, see needsNarrowing(). Returns false otherwise.
+*/
+bool WavParser::isSupported() const
+{
+    if (!m_valid || m_nofChannels < 1 || m_nofChannels > 2)
+        return false;
+
+    switch (m_audioFormat) {
+    case GEWavFormatPcm:
+        return (m_bitsPerSample == 8 || m_bitsPerSample == 16 ||
+                m_bitsPerSample == 24 || m_bitsPerSample == 32);
+    case GEWavFormatFloat:
+        return (m_bitsPerSample == 32);
+    case GEWavFormatImaAdpcm:
+        return (m_bitsPerSample == 4 && m_blockAlign > 0);
+    default:
+        return false;
+    }
+}
+
+
+/*!
+  Returns true if the data is 24 or 32-bit integer PCM, which is narrowed to
+  16 bits when loaded (see AudioConverter::toPcm16()), false otherwise.
+*/
+bool WavParser::needsNarrowing() const
+{
+    return (m_audioFormat == GEWavFormatPcm &&
+            (m_bitsPerSample == 24 || m_bitsPerSample == 32));
+}
+
+
+/*!
+  Clears the results of the previous parse.
+*/
+void WavParser::reset()
+{
+    m_valid = false;
+    m_formatFound = false;
+    m_audioFormat = 0;
+    m_nofChannels = 0;
+    m_samplesPerSec = 0;
+    m_bitsPerSample = 0;
+    m_blockAlign = 0;
+    m_factFrames = 0;
+    m_dataOffset = 0;
+    m_dataLength = 0;
+    m_nextOffset = 0;
+}
+
+
+/*!
+  Checks the RIFF header in the first \a length bytes of \a data. Returns
+  true if the data is a RIFF WAVE file, false otherwise.
+*/
+bool WavParser::parseRiffHeader(const char *data, qint64 length)
+{
+    if (length < GEWavRiffHeaderLength || memcmp(data, "RIFF", 4) != 0 ||
+        memcmp(data + 8, "WAVE", 4) != 0) {
+        // Incorrect header
+        return false;
+    }
+
+    return true;
+}
+
+
+/*!
+  Walks the chunks in \a length bytes of \a data, which starts at \a offset
+  of the file. Returns ParseDone when the data chunk has been found and
+  ParseNeedMore if a chunk to be parsed does not fit in \a data.
+*/
+WavParser::ParseResult WavParser::parseChunks(const char *data,
+                                              qint64 length,
+                                              qint64 offset)
+{
+    qint64 pos(0);
+
+    while (1) {
+        if (pos + GEWavChunkHeaderLength > length) {
+            m_nextOffset = offset + pos;
+            return ParseNeedMore;
+        }
+
+        const char *id = data + pos;
+        const quint32 size(readUint32(data + pos + 4));
+        const char *chunk = id + GEWavChunkHeaderLength;
+        const qint64 chunkEnd(pos + GEWavChunkHeaderLength + size);
+
+        if (memcmp(id, "data", 4) == 0) {
+            if (!m_formatFound)
+                return ParseError;
+
+            m_dataOffset = offset + pos + GEWavChunkHeaderLength;
+            m_dataLength = size;
+            return ParseDone;
+        }
+
+        if (memcmp(id, "fmt ", 4) == 0) {
+            if (size < (quint32)GEWavMinFormatLength ||
+                size > (quint32)GEWavMaxFormatLength) {
+                return ParseError;
+            }
+
+            if (chunkEnd > length) {
+                m_nextOffset = offset + pos;
+                return ParseNeedMore;
+            }
+
+            if (!parseFormat(chunk, (int)size))
+                return ParseError;
+        }
+        else if (memcmp(id, "fact", 4) == 0 && size >= 4) {
+            if (pos + GEWavChunkHeaderLength + 4 > length) {
+                m_nextOffset = offset + pos;
+                return ParseNeedMore;
+            }
+
+            m_factFrames = (int)qMin(readUint32(chunk), (quint32)INT_MAX);
+        }
+
+        // The chunks are padded to an even size.
+        pos = chunkEnd + (size & 1);
+    }
+}
+
+
+/*!
+  Parses the fmt chunk of \a length bytes in \a data. Returns true if
+  successful, false otherwise.
+*/
+bool WavParser::parseFormat(const char *data, int length)
+{
+    m_audioFormat = readUint16(data);
+    m_nofChannels = readUint16(data + 2);
+    m_samplesPerSec = (int)qMin(readUint32(data + 4), (quint32)INT_MAX);
+    m_blockAlign = readUint16(data + 12);
+    m_bitsPerSample = readUint16(data + 14);
+
+    if (m_audioFormat == GEWavFormatExtensible) {
+        if (length < GEWavExtensibleFormatLength) {
+            DEBUG_INFO("Truncated WAVE_FORMAT_EXTENSIBLE header!");
+            return false;
+        }
+
+        // The subformat GUID starts with the format tag.
+        m_audioFormat = readUint16(data + 24);
+    }
+
+    m_formatFound = true;
+    return true;
+}
+
+
+/*!
+  Limits the data to the \a fileSize bytes available and validates the
+  format. Returns true if there is data to play, false otherwise.
+*/
+bool WavParser::finish(qint64 fileSize)
+{
+    if (m_dataOffset + m_dataLength > fileSize) {
+        // Truncated file, use what there is.
+        m_dataLength = qMax((qint64)0, fileSize - m_dataOffset);
+    }
+
+    if (m_audioFormat != GEWavFormatImaAdpcm && m_blockAlign > 0) {
+        // Whole frames only.
+        m_dataLength -= m_dataLength % m_blockAlign;
+    }
+
+    m_dataLength = qMin(m_dataLength, (qint64)INT_MAX);
+    m_valid = (m_dataLength > 0 && m_nofChannels > 0 && m_samplesPerSec > 0);
+
+    if (m_valid && !isSupported()) {
+        DEBUG_INFO("Unsupported format:" << m_audioFormat << ","
+                   << m_bitsPerSample << "bits," << m_nofChannels
+                   << "channels.");
+    }
+
+    return m_valid;
+}
@@ -0,0 +1,78 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ *
+ * Part of the Qt GameEnabler.
+ */
+
+#ifndef GEWAVPARSER_H
+#define GEWAVPARSER_H
+
+#include <QtGlobal>
+
+// Forward declarations
+class QIODevice;
+
+
+namespace GE {
+
+// Constants, the format tags of the fmt chunk
+const int GEWavFormatPcm(0x1);
+const int GEWavFormatFloat(0x3);
+const int GEWavFormatImaAdpcm(0x11);
+const int GEWavFormatExtensible(0xfffe);
+
+
+class WavParser
+{
+public:
+    WavParser();
+
+public:
+    bool parse(const char *data, qint64 length);
+    bool parse(QIODevice *device);
+
+    inline bool isValid() const { return m_valid; }
+    bool isSupported() const;
+    bool needsNarrowing() const;
+
+    inline int audioFormat() const { return m_audioFormat; }
+    inline int nofChannels() const { return m_nofChannels; }
+    inline int samplesPerSec() const { return m_samplesPerSec; }
+    inline int bitsPerSample() const { return m_bitsPerSample; }
+    inline int blockAlign() const { return m_blockAlign; }
+    inline int factFrames() const { return m_factFrames; }
+    inline qint64 dataOffset() const { return m_dataOffset; }
+    inline qint64 dataLength() const { return m_dataLength; }
+
+protected: // Data types
+
+    enum ParseResult {
+        ParseError = 0,
+        ParseDone = 1,
+        ParseNeedMore = 2 // Continue from m_nextOffset
+    };
+
+protected:
+    void reset();
+    bool parseRiffHeader(const char *data, qint64 length);
+    ParseResult parseChunks(const char *data, qint64 length, qint64 offset);
+    bool parseFormat(const char *data, int length);
+    bool finish(qint64 fileSize);
+
+protected: // Data
+    bool m_valid;
+    bool m_formatFound;
+    int m_audioFormat; // GEWavFormatExtensible is resolved to the subformat
+    int m_nofChannels;
+    int m_samplesPerSec;
+    int m_bitsPerSample;
+    int m_blockAlign;
+    int m_factFrames; // 0 if there is no fact chunk
+    qint64 m_dataOffset; // From the beginning of the file
+    qint64 m_dataLength; // In bytes, limited to the available data
+    qint64 m_nextOffset; // Of the chunk not in the parsed data
+};
+
+} // namespace GE
+
+#endif // GEWAVPARSER_H
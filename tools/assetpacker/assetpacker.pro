@@ -0,0 +1,22 @@
+# Copyright (c) 2011 Nokia Corporation.
+
+QT += core
+QT -= gui
+
+TARGET = assetpacker
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+GE_PATH = ../../qtgameenabler
+
+INCLUDEPATH += $${GE_PATH}/src
+
+SOURCES += \
+    main.cpp \
+    $${GE_PATH}/src/assetarchive.cpp
+
+HEADERS += \
+    $${GE_PATH}/src/assetarchive.h
+
+# End of file.
@@ -0,0 +1,71 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ */
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QDirIterator>
+#include <QStringList>
+#include <QTextStream>
+
+#include "assetarchive.h"
+
+
+/*!
+  Packs the files of a directory into an asset archive for
+  GE::AssetArchive, or verifies an existing archive. Meant to be run when
+  the assets are built; exits with a non-zero code on any failure.
+
+  Usage:
+    assetpacker [-c] <directory> <archive>  Packs the files, -c compresses
+    assetpacker -v <archive>                Verifies the archive
+*/
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QStringList arguments(a.arguments());
+    QTextStream out(stdout);
+    GE::AssetArchive::PackFlags flags(GE::AssetArchive::NoPackFlags);
+
+    arguments.removeFirst();
+
+    if (arguments.count() == 2 && arguments[0] == "-v") {
+        GE::AssetArchive archive;
+
+        if (!archive.open(arguments[1]) || !archive.verify()) {
+            out << "Verification failed: " << arguments[1] << "\n";
+            return 1;
+        }
+
+        out << archive.count() << " entries verified.\n";
+        return 0;
+    }
+
+    if (!arguments.isEmpty() && arguments[0] == "-c") {
+        flags |= GE::AssetArchive::CompressEntries;
+        arguments.removeFirst();
+    }
+
+    if (arguments.count() != 2) {
+        out << "Usage: assetpacker [-c] <directory> <archive>\n"
+            << "       assetpacker -v <archive>\n";
+        return 2;
+    }
+
+    const QDir directory(arguments[0]);
+    QDirIterator files(arguments[0], QDir::Files,
+                       QDirIterator::Subdirectories);
+    QStringList names;
+
+    while (files.hasNext())
+        names.append(directory.relativeFilePath(files.next()));
+
+    // pack() verifies the archive after writing.
+    if (!GE::AssetArchive::pack(arguments[1], arguments[0], names, flags)) {
+        out << "Packing failed: " << arguments[1] << "\n";
+        return 1;
+    }
+
+    out << names.count() << " files packed and verified.\n";
+    return 0;
+}
@@ -0,0 +1,16 @@
+# Copyright (c) 2011 Nokia Corporation.
+
+QT += core
+
+TARGET = loadbench
+TEMPLATE = app
+CONFIG += console
+CONFIG -= app_bundle
+
+GE_PATH = ../../qtgameenabler
+include(../../qtgameenabler/qtgameenabler.pri)
+
+SOURCES += \
+    main.cpp
+
+# End of file.
@@ -0,0 +1,233 @@
+/**
+ * Copyright (c) 2011 Nokia Corporation.
+ */
+
+#include <string.h>
+#include <QCoreApplication>
+#include <QDirIterator>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QStringList>
+#include <QTextStream>
+
+#include "audiobuffer.h"
+
+
+/*!
+  A file counting the reads it makes from the operating system.
+*/
+class CountingFile : public QFile
+{
+public:
+    CountingFile(const QString &fileName, int *readCalls)
+        : QFile(fileName),
+          m_readCalls(readCalls)
+    {
+    }
+
+protected: // From QIODevice
+    qint64 readData(char *data, qint64 maxSize)
+    {
+        (*m_readCalls)++;
+        return QFile::readData(data, maxSize);
+    }
+
+protected: // Data
+    int *m_readCalls; // Not owned
+};
+
+
+/*!
+  Gives the benchmark access to the loaders of GE::AudioBuffer.
+*/
+class BenchBuffer : public GE::AudioBuffer
+{
+public:
+    /*!
+      Loads the buffer from \a wavFile with the single-pass loader, which
+      maps the file and parses it with GE::WavParser. Takes the ownership
+      of \a wavFile.
+    */
+    static GE::AudioBuffer *loadSinglePass(QFile *wavFile)
+    {
+        return GE::AudioBuffer::loadWav(wavFile);
+    }
+
+    /*!
+      Loads the buffer from \a wavFile the way the loader used to before
+      GE::WavParser: a read() call for each header field and each skipped
+      chunk, then the data into a new buffer. 8 and 16-bit PCM only.
+    */
+    static GE::AudioBuffer *loadFieldByField(QFile &wavFile)
+    {
+        char id[4];
+        quint32 size(0);
+        quint16 channels(0);
+        quint32 rate(0);
+        quint16 bits(0);
+        quint16 field16(0);
+        quint32 field32(0);
+
+        if (wavFile.read(id, 4) != 4 || memcmp(id, "RIFF", 4) != 0 ||
+            wavFile.read((char*)&size, 4) != 4 ||
+            wavFile.read(id, 4) != 4 || memcmp(id, "WAVE", 4) != 0 ||
+            wavFile.read(id, 4) != 4 || memcmp(id, "fmt ", 4) != 0) {
+            return 0;
+        }
+
+        wavFile.read((char*)&size, 4);
+        wavFile.read((char*)&field16, 2); // Audio format
+        wavFile.read((char*)&channels, 2);
+        wavFile.read((char*)&rate, 4);
+        wavFile.read((char*)&field32, 4); // Byte rate
+        wavFile.read((char*)&field16, 2); // Block align
+        wavFile.read((char*)&bits, 2);
+
+        while (1) {
+            if (wavFile.read(id, 4) != 4 ||
+                wavFile.read((char*)&size, 4) != 4) {
+                return 0;
+            }
+
+            if (memcmp(id, "data", 4) == 0)
+                break;
+
+            // Not the data chunk, skip it.
+            if (size < 1)
+                return 0;
+
+            char *unused = new char[size];
+            wavFile.read(unused, size);
+            delete [] unused;
+        }
+
+        if (size < 1)
+            return 0;
+
+        BenchBuffer *buffer = new BenchBuffer;
+        buffer->m_nofChannels = channels;
+        buffer->m_bitsPerSample = bits;
+        buffer->m_samplesPerSec = rate;
+        buffer->reallocate(size);
+
+        if (wavFile.read((char*)buffer->m_data, size) != (qint64)size ||
+            !setSampleFunction(*buffer)) {
+            delete buffer;
+            return 0;
+        }
+
+        return buffer;
+    }
+};
+
+
+/*!
+  Loads each of \a fileNames \a rounds times and returns the average time to
+  load one file in milliseconds. If \a fieldByField is true, the files are
+  loaded the way the loader used to, otherwise with the current loader.
+  Both construct a buffer with a copy of the samples. \a readCalls is set
+  to the average number of reads made from the operating system per file;
+  a mapped file makes none, and QFile buffers the small reads.
+*/
+double measureLoadTime(const QStringList &fileNames,
+                       bool fieldByField,
+                       int rounds,
+                       int *readCalls)
+{
+    int reads(0);
+    int failures(0);
+    QElapsedTimer timer;
+    timer.start();
+
+    for (int round = 0; round < rounds; round++) {
+        for (int i = 0; i < fileNames.count(); i++) {
+            CountingFile *file = new CountingFile(fileNames[i], &reads);
+            GE::AudioBuffer *buffer(0);
+
+            if (file->open(QIODevice::ReadOnly)) {
+                if (fieldByField) {
+                    buffer = BenchBuffer::loadFieldByField(*file);
+                    delete file;
+                }
+                else {
+                    // Takes the ownership of the file.
+                    buffer = BenchBuffer::loadSinglePass(file);
+                }
+            }
+            else {
+                delete file;
+            }
+
+            if (!buffer)
+                failures++;
+
+            delete buffer;
+        }
+    }
+
+    const qint64 elapsed(timer.elapsed());
+    const int loads(rounds * fileNames.count());
+
+    if (failures > 0)
+        QTextStream(stderr) << failures << " loads failed.\n";
+
+    *readCalls = reads / loads;
+    return (double)elapsed / (double)loads;
+}
+
+
+/*!
+  Measures loading the .wav files of a directory with the loader which
+  read the header field by field and with the current single-pass loader.
+  Prints the average time and the number of reads from the operating system
+  per file for both.
+
+  Usage:
+    loadbench [-r <rounds>] <directory>
+*/
+int main(int argc, char *argv[])
+{
+    QCoreApplication a(argc, argv);
+    QStringList arguments(a.arguments());
+    QTextStream out(stdout);
+    int rounds(10);
+
+    arguments.removeFirst();
+
+    if (arguments.count() == 3 && arguments[0] == "-r") {
+        rounds = arguments[1].toInt();
+        arguments.removeFirst();
+        arguments.removeFirst();
+    }
+
+    if (arguments.count() != 1 || rounds < 1) {
+        out << "Usage: loadbench [-r <rounds>] <directory>\n";
+        return 2;
+    }
+
+    QDirIterator files(arguments[0], QStringList() << "*.wav", QDir::Files,
+                       QDirIterator::Subdirectories);
+    QStringList names;
+
+    while (files.hasNext())
+        names.append(files.next());
+
+    if (names.isEmpty()) {
+        out << "No .wav files in " << arguments[0] << "\n";
+        return 1;
+    }
+
+    int reads(0);
+
+    out << names.count() << " files, " << rounds << " rounds.\n";
+
+    double ms(measureLoadTime(names, true, rounds, &reads));
+    out << "Field by field: " << ms << " ms, " << reads
+        << " reads per file.\n";
+
+    ms = measureLoadTime(names, false, rounds, &reads);
+    out << "Single pass:    " << ms << " ms, " << reads
+        << " reads per file.\n";
+
+    return 0;
+}